@@ -0,0 +1,107 @@
+#ifndef DD_H
+#define DD_H
+
+// Double-double numbers, the unevaluated sum of two doubles where lo is
+// under half a unit in the last place of hi. That gives about 106 bits,
+// enough for views down to around 1e-30 wide.
+// The products are split with Dekker's method rather than fused
+// multiply-adds, both give the exact rounding error so the vector
+// kernels that do use fused multiply-adds get the same results
+typedef struct brot_dd {
+    double hi;
+    double lo;
+} Brot_DD;
+
+static inline Brot_DD brot_dd_quick_two_sum(double a, double b)
+{
+    Brot_DD r;
+
+    r.hi = a + b;
+    r.lo = b - (r.hi - a);
+
+    return r;
+}
+
+static inline Brot_DD brot_dd_two_sum(double a, double b)
+{
+    Brot_DD r;
+
+    r.hi = a + b;
+    double bb = r.hi - a;
+    r.lo = (a - (r.hi - bb)) + (b - bb);
+
+    return r;
+}
+
+// Splits a double into two halves of 26 bits so their products are exact
+static inline void brot_dd_split(double a, double *hi, double *lo)
+{
+    double t = 134217729.0 * a;
+
+    *hi = t - (t - a);
+    *lo = a - *hi;
+}
+
+static inline Brot_DD brot_dd_two_prod(double a, double b)
+{
+    Brot_DD r;
+    double ah, al, bh, bl;
+
+    r.hi = a * b;
+
+    brot_dd_split(a, &ah, &al);
+    brot_dd_split(b, &bh, &bl);
+
+    r.lo = ((ah * bh - r.hi) + ah * bl + al * bh) + al * bl;
+
+    return r;
+}
+
+static inline Brot_DD brot_dd_add(Brot_DD a, Brot_DD b)
+{
+    Brot_DD s = brot_dd_two_sum(a.hi, b.hi);
+    Brot_DD t = brot_dd_two_sum(a.lo, b.lo);
+
+    s.lo += t.hi;
+    s = brot_dd_quick_two_sum(s.hi, s.lo);
+    s.lo += t.lo;
+
+    return brot_dd_quick_two_sum(s.hi, s.lo);
+}
+
+static inline Brot_DD brot_dd_sub(Brot_DD a, Brot_DD b)
+{
+    b.hi = -b.hi;
+    b.lo = -b.lo;
+
+    return brot_dd_add(a, b);
+}
+
+static inline Brot_DD brot_dd_add_double(Brot_DD a, double b)
+{
+    Brot_DD s = brot_dd_two_sum(a.hi, b);
+
+    s.lo += a.lo;
+
+    return brot_dd_quick_two_sum(s.hi, s.lo);
+}
+
+static inline Brot_DD brot_dd_mul(Brot_DD a, Brot_DD b)
+{
+    Brot_DD p = brot_dd_two_prod(a.hi, b.hi);
+
+    p.lo += a.hi * b.lo + a.lo * b.hi;
+
+    return brot_dd_quick_two_sum(p.hi, p.lo);
+}
+
+static inline Brot_DD brot_dd_sqr(Brot_DD a)
+{
+    Brot_DD p = brot_dd_two_prod(a.hi, a.hi);
+
+    p.lo += 2.0 * a.hi * a.lo;
+
+    return brot_dd_quick_two_sum(p.hi, p.lo);
+}
+
+#endif
@@ -0,0 +1,39 @@
+#ifndef DISTRIBUTE_H
+#define DISTRIBUTE_H
+
+#include "mandelbrot.h"
+
+// Width and height in pixels of the jobs the frame is split into for workers
+// Big enough that the socket traffic is small next to the iterating
+#define BROT_JOB_SIZE 256
+
+// How many jobs each worker is sent ahead, so it has the next one
+// to start on while its last result is on the way back
+#define BROT_JOBS_IN_FLIGHT 2
+
+typedef struct brot_worker_set *Brot_Workers;
+
+// Forks the given number of worker processes, each on its own Unix domain
+// socket, splitting the CPUs between them. This has to happen while the
+// process only has one thread, so before brot_create starts the pool
+// Returns NULL if they couldn't all be started
+Brot_Workers brot_workers_start(int count);
+
+// Stops workers that weren't given a frame, for when something fails
+// between starting them and brot_distribute
+void brot_workers_stop(Brot_Workers workers);
+
+// Calculates the frame by handing the workers jobs over their sockets.
+// The workers send back the raw and fraction values and the scaling and
+// colouring is done here, so the result is the same as brot_smooth_calculate.
+// The messages are the structs as they are in memory, so the workers
+// have to be the same build on the same kind of machine
+// The workers are stopped afterwards either way
+// Returns NULL if a worker stopped part way
+Mandelbrot brot_distribute(Mandelbrot brot, Brot_Workers workers);
+
+// Runs a worker on an already connected socket until the coordinator
+// tells it to stop. Returns 0 on a clean finish
+int brot_worker_run(int fd, int threads);
+
+#endif
@@ -0,0 +1,59 @@
+#ifndef FIXED_H
+#define FIXED_H
+
+#include <stdint.h>
+
+#include "dd.h"
+
+// Most 32 bit limbs a number can have, limb 0 is the integer part
+// and the rest are the fraction, so this is good for about 1e-330
+#define BROT_FIXED_MAX_LIMBS 36
+
+// Fewest limbs a number is kept at
+#define BROT_FIXED_MIN_LIMBS 4
+
+// An arbitrary precision fixed point number, stored as a sign and
+// a magnitude. limb[0] is the integer part and limb[i] holds the
+// fraction bits weighted by 2^(-32 i). Only the first limbs are used,
+// the rest are always kept at zero so the precision can be raised
+// without changing the value
+typedef struct brot_fixed {
+    int sign;
+    int limbs;
+    uint32_t limb[BROT_FIXED_MAX_LIMBS];
+} Brot_Fixed;
+
+// Sets the number from a double, exactly if the precision allows
+void brot_fixed_from_double(Brot_Fixed *out, double value, int limbs);
+
+// Reads a decimal number such as -0.7436438870371587047521915
+// Returns 0 if the string isn't a number
+int brot_fixed_from_string(Brot_Fixed *out, const char *text, int limbs);
+
+double brot_fixed_to_double(const Brot_Fixed *value);
+
+// Rounds the number to a double-double
+void brot_fixed_to_dd(const Brot_Fixed *value, Brot_DD *out);
+
+// Changes the precision, dropping limbs or adding zero limbs
+void brot_fixed_set_limbs(Brot_Fixed *value, int limbs);
+
+// The results of these have the larger precision of the two inputs
+// and out can be the same as either input
+void brot_fixed_add(Brot_Fixed *out, const Brot_Fixed *a, const Brot_Fixed *b);
+void brot_fixed_sub(Brot_Fixed *out, const Brot_Fixed *a, const Brot_Fixed *b);
+void brot_fixed_mul(Brot_Fixed *out, const Brot_Fixed *a, const Brot_Fixed *b);
+
+// Adds a double to the number, at the number's precision
+void brot_fixed_add_double(Brot_Fixed *value, double add);
+
+// Divides the number by a small whole number
+void brot_fixed_div_small(Brot_Fixed *value, uint32_t divisor);
+
+int brot_fixed_equal(const Brot_Fixed *a, const Brot_Fixed *b);
+
+// The number of limbs needed to tell apart points the given distance apart,
+// with enough extra bits for the reference orbit to stay accurate
+int brot_fixed_limbs_for(double spacing);
+
+#endif
@@ -0,0 +1,13 @@
+#ifndef IMAGE_H
+#define IMAGE_H
+
+#include "mandelbrot.h"
+
+// Packs a row of canvas colours into the 8-bit RGB the PNG encoder takes
+void render_png_scanline(const uint32_t *colours, unsigned char *scanline, int width);
+
+// Writes the canvas out as a PNG file
+// Gives back the lodepng error code, 0 when it worked
+unsigned render_png(Mandelbrot brot, char* output_file);
+
+#endif
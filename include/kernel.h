@@ -0,0 +1,48 @@
+#ifndef KERNEL_H
+#define KERNEL_H
+
+#include "mandelbrot.h"
+
+// The vectorised kernels run several adjacent pixels of a row at once,
+// one pixel per lane, and stop updating a lane as soon as it escapes.
+// They do the same double operations in the same order as
+// brot_calc_smooth_value and work out the final log-log smoothing
+// with the same scalar code, so with -ffp-contract=off (set in the
+// makefile) the results are identical. If the compiler is allowed to
+// contract multiplies and adds into fused multiply-adds the values can
+// differ by a few units in the last place, which is well inside this
+// tolerance and far below anything the colouring can show.
+#define BROT_KERNEL_TOLERANCE 1e-9
+
+// Pixels further apart than this are calculated in floats. Floats only
+// hold about 7 digits and the rounding builds up over the orbit, so
+// closer than this too many pixels near the edge of the set change
+// colour. At this spacing it is still well under one pixel in a hundred
+#define BROT_FLOAT_SPACING 5e-4
+
+// Pixels closer together than this can't be told apart by doubles and are
+// calculated in double-doubles instead
+#define BROT_DOUBLE_SPACING 1e-14
+
+// Finds the best double precision kernel that this CPU can run
+Brot_Kernel brot_kernel_select(Brot_ISA *isa);
+
+// The float kernel for the instruction set brot_kernel_select picked
+Brot_Kernel brot_kernel_float(Brot_ISA isa);
+
+// The double-double kernel for the instruction set, only scalar and AVX2
+Brot_Kernel brot_kernel_dd(Brot_ISA isa);
+
+// Gets a readable name for the instruction set, useful for reporting
+const char *brot_isa_name(Brot_ISA isa);
+
+// The plain one pixel at a time kernel, works everywhere
+void brot_kernel_scalar(Mandelbrot brot, int xPos, int yPos, int count, int step, uint16_t *fraction, int *raw);
+
+// The same again, but iterating in floats
+void brot_kernel_scalar_float(Mandelbrot brot, int xPos, int yPos, int count, int step, uint16_t *fraction, int *raw);
+
+// And in double-doubles, around the full precision centre of the view
+void brot_kernel_scalar_dd(Mandelbrot brot, int xPos, int yPos, int count, int step, uint16_t *fraction, int *raw);
+
+#endif
@@ -214,6 +214,27 @@ unsigned lodepng_encode32_file(const char* filename,
 /*Same as lodepng_encode_file, but always encodes from 24-bit RGB raw image.*/
 unsigned lodepng_encode24_file(const char* filename,
                                const unsigned char* image, unsigned w, unsigned h);
+
+/*
+Streaming encoder, for images too big to hold in memory all at once.
+The image is given one scanline at a time, top to bottom, and each is filtered,
+deflated and written to the file as IDAT chunks as soon as a block fills up.
+Only a couple of scanlines, one deflate block and the LZ77 window are held at once.
+The PNG is always 8-bit RGB and not interlaced, a smaller color type can't be
+picked from the content since the whole image is never seen at once.
+Needs LODEPNG_COMPILE_ZLIB, it uses LodePNG's own deflate.
+*/
+typedef struct LodePNGStream LodePNGStream;
+
+/*Creates the file and writes the header. On error *stream is set to NULL.*/
+unsigned lodepng_stream_open(LodePNGStream** stream, const char* filename, unsigned w, unsigned h);
+
+/*Adds the next scanline, w * 3 bytes of RGB.*/
+unsigned lodepng_stream_push(LodePNGStream* stream, const unsigned char* scanline);
+
+/*Finishes the file and frees the stream, whether or not there was an error.
+Fails with error 88 if fewer than h scanlines were pushed.*/
+unsigned lodepng_stream_close(LodePNGStream* stream);
 #endif /*LODEPNG_COMPILE_DISK*/
 #endif /*LODEPNG_COMPILE_ENCODER*/
 
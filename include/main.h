@@ -4,7 +4,41 @@
 typedef struct input_args {
     int   width;
     int   height;
+    int   repeats;
+
+    // The view to render, bottom left and top right corners
+    double x1;
+    double y1;
+    double x2;
+    double y2;
+
+    // A full precision centre and width for the view, used instead of
+    // the corners when centerX is set. Needed for deep zooms
+    char  *centerX;
+    char  *centerY;
+    double width_span;
+
+    // The name of the palette to colour with, NULL for the default
+    char  *palette;
+
+    // histogram or linear, NULL for the default
+    char  *colouring;
+
+    // Worker processes to split the frame between, headless only
+    // Zero calculates it all in this process
+    int    workers;
+
+    // A directory to keep the planes in as mapped files, headless only
+    // For images too big to calculate in memory
+    char  *mapped_dir;
+
     char  *output_file;
 } Args;
 
+void usage(int exitval);
+
+// Reads the options for the headless renderer, or when headless
+// is 0 the smaller set the viewer takes
+Args parse_args(int argc, char *argv[], int headless);
+
 #endif
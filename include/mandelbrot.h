@@ -2,8 +2,159 @@
 #define BROT_H
 
 #include <stdint.h>
+#include <stdatomic.h>
+
+#include "pool.h"
+#include "fixed.h"
+
+// Width and height in pixels of the tiles the frame is split into
+// Each tile is calculated by a single thread
+#define BROT_TILE_SIZE 64
+
+// Fewest rows a piece of a tile can be split down to, when threads
+// that have run out of work are waiting for some
+#define BROT_SPLIT_ROWS 8
+
+// The gap between the pixels of the first rough pass of a progressive frame
+// Each pass after halves it, so 4 gives passes of 1/16, 1/4 and then every pixel
+#define BROT_PREVIEW_STEP 4
+
+// How close, as a fraction of the width of a pixel, an orbit has to come
+// back to a previous point before it is treated as periodic
+#define BROT_PERIOD_TOLERANCE 1e-3
+
+// How close, as a fraction of a pixel, a new pixel has to be to one
+// from the previous frame for the old value to be reused
+#define BROT_REUSE_TOLERANCE 1e-6
+
+// How many previous views are kept so zooming back out is instant
+// Each one holds a full set of planes, 10 bytes a pixel
+#define BROT_HISTORY_DEPTH 8
+
+// Alignment in bytes of the start of each plane, and the amount
+// each row is padded to, so rows always start on a cache line
+#define BROT_PLANE_ALIGN 64
+
+// Smooth values aren't stored whole. The raw plane has the iteration count
+// and the fraction plane has how far the smooth value is from it, in 16 bit
+// fixed point. BROT_FRACTION_OFFSET is added first so the fractions, which
+// are a little over 0 up to about 1.5 for anything near the set, are positive
+// Steps of 1/16384 of an iteration are far finer than the palette can show
+#define BROT_FRACTION_ONE 16384
+#define BROT_FRACTION_OFFSET 2
 
 typedef struct mandelbrot_fractal *Mandelbrot;
+
+// How one of the pool's threads spent the calculation of the last frame
+typedef struct brot_thread_stats {
+    // Seconds spent calculating, and looking for or waiting for work
+    double busy;
+    double idle;
+
+    // Pieces of work finished, and how many of those came off other threads
+    int pieces;
+    int steals;
+} Brot_Thread_Stats;
+
+// The instruction sets that the escape time kernels have been written for
+typedef enum {
+    BROT_ISA_SCALAR,
+    BROT_ISA_AVX2,
+    BROT_ISA_AVX512
+} Brot_ISA;
+
+// The number types a frame can be calculated with, picked from the
+// pixel spacing. Each one has its own kernel
+typedef enum {
+    // Floats, twice as many pixels per vector as doubles
+    BROT_PRECISION_FLOAT,
+    BROT_PRECISION_DOUBLE,
+
+    // Pairs of doubles, good for about 32 digits
+    BROT_PRECISION_DOUBLE_DOUBLE,
+
+    // Double offsets from a full precision reference orbit
+    BROT_PRECISION_PERTURB
+} Brot_Precision;
+
+// How the smooth values are spread along the palette
+typedef enum {
+    // Each part of the palette gets the same number of pixels, from the
+    // histogram of the iterations of the whole frame
+    BROT_COLOUR_HISTOGRAM,
+
+    // The palette runs evenly from the lowest value in the frame to the highest
+    BROT_COLOUR_LINEAR
+} Brot_Colouring;
+
+// Called between the passes of a progressive frame, once the canvas holds
+// the rough version of the frame so far
+typedef void (*Brot_Progress)(Mandelbrot brot, void *data);
+
+// Calculates count pixels along a row, starting at xPos and step pixels
+// apart, and writes them next to each other in fraction and raw
+// The iteration counts go to raw, with repeats for points in the set
+typedef void (*Brot_Kernel)(Mandelbrot brot, int xPos, int yPos, int count, int step, uint16_t *fraction, int *raw);
+
+// The ways the frame can be calculated
+typedef enum {
+    // Every pixel is iterated
+    BROT_RENDER_FULL,
+
+    // Mariani-Silver subdivision, only rectangles whose whole border is
+    // inside the set are filled in without iterating
+    // Because the set is connected and has no holes this gives the same
+    // image as BROT_RENDER_FULL, short of features thinner than a pixel
+    // slipping between the border samples
+    BROT_RENDER_SUBDIVIDE_EXACT,
+
+    // Mariani-Silver subdivision that also fills rectangles whose border
+    // all escaped on the same iteration, interpolating the smooth values
+    // from the border. Faster, but can miss small details
+    BROT_RENDER_SUBDIVIDE_GUESS
+} Brot_Render_Mode;
+
+// A full set of planes along with the view and settings they were
+// calculated with. Snapshots are shared between the current frame,
+// the home view and the zoom history, and are counted so the
+// planes are only freed once nothing refers to them
+typedef struct brot_snapshot {
+
+    uint32_t *canvas;
+    int *raw_values;
+    uint16_t *fraction_values;
+
+    // Set once the planes hold a finished frame
+    int computed;
+
+    // How the values were spread along the palette when the canvas was
+    // coloured, so it can be coloured again without scanning the values
+    struct brot_colour_scale *scale;
+
+    // The brot's palette_version when the canvas was coloured
+    int palette_version;
+
+    double x1;
+    double y1;
+    double x2;
+    double y2;
+
+    Brot_Fixed centerX;
+    Brot_Fixed centerY;
+    double spanX;
+    double spanY;
+
+    int repeats;
+    int interior_check;
+    int periodicity_check;
+
+    // The precision the values were calculated in
+    Brot_Precision precision;
+
+    int refs;
+
+} Brot_Snapshot;
+
 typedef struct mandelbrot_fractal {
 
     // The coordinates of the bottom left corner
@@ -23,42 +174,265 @@ typedef struct mandelbrot_fractal {
     double startX2;
     double startY2;
 
+    // The centre of the view at full precision and the size of the view,
+    // spanX = x2 - x1 and spanY = y1 - y2. These keep working once the
+    // view is too small for the corner coordinates to tell pixels apart
+    // The centre gains precision as the view gets smaller
+    Brot_Fixed centerX;
+    Brot_Fixed centerY;
+    double spanX;
+    double spanY;
+
     // The size of the area in pixels
     // Allows us to calculate the complex
     // number value for each pixel
     int pixelWidth;
     int pixelHeight;
 
-    // A 2D array of the pixels in the image
-    uint32_t **canvas;
+    // Each of the planes below is one contiguous block of memory
+    // holding the image row by row, starting on a cache line.
+    // stride is the number of elements from the start of one row
+    // to the start of the next, and is at least pixelWidth.
+    // The value for pixel (x, y) is at plane[y * stride + x]
+    int stride;
+
+    // The planes below belong to the current snapshot
+    Brot_Snapshot *current;
+
+    // The colours of the pixels in the image
+    uint32_t *canvas;
 
-    // A 2D array of the raw escape values for the Mandelbrot set
+    // The raw escape values for the Mandelbrot set
     // Will store the values detailing how many
-    // iterations the calculation took to escape
-    int **raw_values;
+    // iterations the calculation took to escape,
+    // with repeats for the points in the set
+    int *raw_values;
 
-    // A 2D array of the smoothed Mandelbrot values
-    double **smooth_values;
+    // What to add to the raw values to get the smoothed Mandelbrot values,
+    // see BROT_FRACTION_ONE. Along with the raw values these are everything
+    // needed to colour the frame again without iterating
+    uint16_t *fraction_values;
 
     // Maximum number of iterations we'll go through
     // to see if the pixel escapes the bounds
     int repeats;
 
+    // When set, points in the main cardioid and the period 2 bulb
+    // are recognised straight away and never iterated
+    // On by default, turn it off to check the kernels against
+    // the full iteration
+    int interior_check;
+
+    // When set, orbits are checked for cycles as they are iterated
+    // and points with periodic orbits are stopped early as inside the set
+    // On by default
+    int periodicity_check;
+
+    // How the frame is calculated, BROT_RENDER_FULL by default
+    Brot_Render_Mode render_mode;
+
+    // The first frame calculated at the start coordinates,
+    // so resetting the zoom doesn't need to calculate anything
+    Brot_Snapshot *home;
+
+    // The frames from before each zoom, newest last
+    Brot_Snapshot *history[BROT_HISTORY_DEPTH];
+    int history_count;
+
+    // A set of planes that is no longer used, kept so the
+    // next frame doesn't need to allocate new ones
+    Brot_Snapshot *spare;
+
+    // When a frame is calculated the pixels that line up with the
+    // previous frame are reused. Pure pans by whole pixels and zooms
+    // by whole number ratios that start on a pixel line up
+    // How many pixels of the last frame were reused instead of iterated
+    long reused_pixels;
+
+    // The threads used to calculate the tiles of the image
+    Pool pool;
+
+    // If set, frames are calculated in rough passes first and this is
+    // called with progress_data after each one so they can be shown
+    Brot_Progress progress;
+    void *progress_data;
+
+    // Set from another thread to give up on the frame being calculated
+    // It's checked before each tile, so the frame stops within a tile's
+    // worth of work. It stays set until whoever set it clears it
+    atomic_int cancel;
+
+    // How each thread spent the last frame, to check the load balance
+    Brot_Thread_Stats *thread_stats;
+    int thread_count;
+
+    // The escape time kernels picked for this CPU when the struct was created
+    Brot_Kernel vector_kernel;
+    Brot_Kernel float_kernel;
+    Brot_Kernel dd_kernel;
+    Brot_ISA isa;
+
+    // The kernel used for the frame being calculated, and the precision
+    // it was picked for. Wide views use floats, then doubles, then
+    // double-doubles, and past those perturbation
+    Brot_Kernel kernel;
+    Brot_Precision precision;
+
+    // The centre rounded to double-doubles for the double-double kernels
+    Brot_DD ddCenterX;
+    Brot_DD ddCenterY;
+
+    // The full precision orbit deep frames are calculated around
+    struct brot_reference *reference;
+
+    // The colours the smooth values are looked up in
+    struct brot_palette *palette;
+
+    // How the values are spread along the palette, histogram by default
+    Brot_Colouring colouring;
+
+    // Goes up whenever the palette or the colouring changes, so canvases
+    // coloured before can be told apart
+    int palette_version;
+
+    // How many pixels of the last deep frame had to be rebased
+    // because of glitches
+    atomic_long glitches;
+
 } Mandelbrot_Data;
 
 // Create the Mandelbrot Data struct and populate it with data
 Mandelbrot brot_create(int pixWidth, int pixHeight, int repeats, double x1, double y1, double x2, double y2);
 
+// The same, with a pool of the given number of threads rather than one per online CPU
+Mandelbrot brot_create_threads(int pixWidth, int pixHeight, int repeats, double x1, double y1, double x2, double y2,
+                               int threads);
+
+// The functions that move the view and calculate the new frame give back
+// NULL if the frame was cancelled. The view still moves, only the canvas
+// and planes are left unfinished
 Mandelbrot brot_zoom(Mandelbrot brot, double x1, double y1, double x2, double y2);
 
 Mandelbrot brot_reset_zoom(Mandelbrot brot);
 
+// Sets the view from a centre given as decimal strings, to whatever
+// precision they are written to, and the width of the view
+// The height follows from the shape of the image
+// Gives back NULL if the centre can't be read
+Mandelbrot brot_set_view(Mandelbrot brot, const char *centerX, const char *centerY, double width);
+
+// Switches to one of the built in palettes for the frames after
+// Gives back NULL, leaving the palette as it was, if there's none by that name
+Mandelbrot brot_set_palette(Mandelbrot brot, const char *name);
+
+// Switches between histogram and linear colouring for the frames after
+// Gives back NULL, leaving the colouring as it was, if the name isn't one of them
+Mandelbrot brot_set_colouring(Mandelbrot brot, const char *name);
+
+// Moves the colours along the palette by steps of its table, for cycling
+// the palette. Like the palette setters, this only takes effect when the
+// canvas is next coloured
+Mandelbrot brot_cycle_palette(Mandelbrot brot, int steps);
+
+// Colours the canvas again from the raw and fraction values of the current
+// frame without iterating any of it, for after the palette or the colouring
+// has changed. Only a change of colouring needs the values scanned again
+// Gives back NULL if the current frame never finished
+Mandelbrot brot_recolour(Mandelbrot brot);
+
+// Goes back to the view from before the last zoom
+Mandelbrot brot_zoom_out(Mandelbrot brot);
+
+// Moves the view by a whole number of pixels, only the newly
+// uncovered pixels need to be calculated
+Mandelbrot brot_pan(Mandelbrot brot, int xPixels, int yPixels);
+
+// Gives back NULL if the frame was cancelled part way, in which case
+// none of the canvas should be shown
 Mandelbrot brot_smooth_calculate(Mandelbrot brot);
 
+// Picks the precision for the current view from the pixel spacing, without
+// setting anything up for it. Enough when nothing is calculated here
+void brot_pick_precision(Mandelbrot brot);
+
+// Picks the precision and kernel for the current view from the pixel spacing
+// brot_smooth_calculate does this itself, it's only needed before
+// calling brot_compute_region
+void brot_select_kernel(Mandelbrot brot);
+
+// Calculates the fraction and raw values for the pixels from xStart, yStart up to
+// but not including xEnd, yEnd into the given buffers rather than the planes.
+// The buffers start at the first pixel of the rectangle and rows are stride apart
+void brot_compute_region(Mandelbrot brot, int xStart, int yStart, int xEnd, int yEnd,
+                         uint16_t *fraction, int *raw, int stride);
+
+// Updates the highest and lowest smooth values with count pixels of a row
+// The pixels that never escaped don't count towards either
+void brot_span_stats(Mandelbrot brot, const int *raw, const uint16_t *fraction, int count,
+                     double *highest, double *lowest);
+
+// Scales and colours values that were put in the planes by something
+// other than brot_smooth_calculate, such as worker processes
+Mandelbrot brot_smooth_colour(Mandelbrot brot);
+
 double brot_scale_value(double value, double high, double low);
 
 double brot_calc_smooth_value(Mandelbrot brot, int xPos, int yPos);
 
+// Same as brot_calc_smooth_value but also gives back the iteration count
+double brot_calc_escape(Mandelbrot brot, int xPos, int yPos, int *iteration);
+
+// Checks if a point is in the main cardioid or the period 2 bulb
+// so it is definitely in the set
+int brot_in_main_regions(double x, double y);
+
+// Gets the distance under which two points of an orbit are taken
+// to be the same when looking for cycles
+double brot_period_epsilon(Mandelbrot brot);
+
+// The distance between neighbouring pixels in the current view
+double brot_pixel_spacing(Mandelbrot brot);
+
+// Gets a readable name for the precision, useful for reporting
+const char *brot_precision_name(Brot_Precision precision);
+
+// Gets the name brot_set_colouring takes for a colouring
+const char *brot_colouring_name(Brot_Colouring colouring);
+
+// Turns the final iteration count and position of a point into its smooth value
+double brot_escape_value(Mandelbrot brot, int iteration, double x, double y);
+
+// Turns the final iteration count and position of a point into the fraction
+// that is stored for it
+uint16_t brot_escape_fraction(Mandelbrot brot, int iteration, double x, double y);
+
+// Packs a smooth value into the fraction stored alongside its iteration count
+static inline uint16_t brot_fraction_pack(int iteration, double smooth)
+{
+    double fraction = (smooth - iteration + BROT_FRACTION_OFFSET) * BROT_FRACTION_ONE + 0.5;
+
+    // Points in the set have no fraction, and views far outside the set
+    // can have points that escape further out than the fraction reaches
+    if (!(fraction > 0)) {
+        return 0;
+    }
+    if (fraction > UINT16_MAX) {
+        return UINT16_MAX;
+    }
+
+    return (uint16_t)fraction;
+}
+
+// Gets back the smooth value of a pixel, -1 for points in the set
+static inline double brot_fraction_value(int repeats, int iteration, uint16_t fraction)
+{
+    if (iteration >= repeats) {
+        return -1.0;
+    }
+
+    return iteration + (double)fraction / BROT_FRACTION_ONE - BROT_FRACTION_OFFSET;
+}
+
 uint32_t colour_from_hue(double value);
 
 // Cleanup the Mandelbrot data struct and free all the assigned memory
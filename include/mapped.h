@@ -0,0 +1,22 @@
+#ifndef MAPPED_H
+#define MAPPED_H
+
+#include "mandelbrot.h"
+
+// Roughly how much of the planes is mapped at once. The frame is worked
+// through in bands of whole rows this big, so that's about all of it
+// that has to be in memory at any time
+#define BROT_BAND_BYTES (64 * 1024 * 1024)
+
+// Renders the frame straight to a PNG without ever holding all of it,
+// for images too big for memory. The raw and fraction values go into
+// files in the given directory, which are mapped a band at a time.
+// The bands are calculated first, then scanned for the highest and
+// lowest values, then coloured and streamed into the PNG in order.
+// The output is the same as brot_smooth_calculate and render_png.
+// The brot's own planes are never touched so they never get any memory
+// behind them, if they could be allocated at all
+// Gives back the lodepng error, or 1 if the files couldn't be set up
+unsigned brot_render_mapped(Mandelbrot brot, const char *directory, char *output_file);
+
+#endif
@@ -0,0 +1,95 @@
+#ifndef PALETTE_H
+#define PALETTE_H
+
+#include <stdint.h>
+
+#include "mandelbrot.h"
+
+// How many colours a palette is baked into. The colouring only picks an
+// entry, so any palette costs the same per pixel. Small enough that the
+// table stays in the L1 cache, and the hue palette is still never more
+// than one level out on any channel from working the colour out exactly
+#define BROT_PALETTE_SIZE 4096
+
+// The palette frames are coloured with unless another is picked
+#define BROT_DEFAULT_PALETTE "hue"
+
+// The most bins an iteration histogram has. With more iterations than
+// this, neighbouring iteration counts share bins
+#define BROT_HISTOGRAM_BINS 65536
+
+// Gives the colour for a position from 0 up to 1 along a palette
+typedef uint32_t (*Brot_Palette_Colour)(double position);
+
+typedef struct brot_palette {
+    const char *name;
+
+    // Whether the end of the palette runs back into the start,
+    // like the hue wheel, rather than stopping at its last colour
+    int cyclic;
+
+    // Each entry is the colour at the middle of its share of the palette
+    // The extra one on the end is for a position of exactly 1, the highest
+    // pixel of the frame, which is the start again for cyclic palettes
+    uint32_t colours[BROT_PALETTE_SIZE + 1];
+} Brot_Palette;
+
+// How the smooth values of a frame are spread along the palette
+typedef struct brot_colour_scale {
+    // For linear colouring, the values at the start and end of the palette
+    double highest;
+    double lowest;
+
+    // For histogram colouring, how far into the palette table each bin of
+    // iterations starts, with one more entry for the end of the last bin
+    // NULL when the colouring is linear
+    double *cdf;
+    int bins;
+    int repeats;
+} Brot_Colour_Scale;
+
+// Bakes a palette from a function giving its colour at each position
+Brot_Palette *brot_palette_bake(const char *name, Brot_Palette_Colour colour, int cyclic);
+
+// Bakes a palette that blends evenly between a list of colours
+// A cyclic one blends from the last colour back to the first at the end
+Brot_Palette *brot_palette_gradient(const char *name, const uint32_t *stops, int count, int cyclic);
+
+// Bakes one of the built in palettes, gives back NULL if there isn't one by that name
+Brot_Palette *brot_palette_named(const char *name);
+
+// The names of the built in palettes in order, NULL past the last one
+const char *brot_palette_name(int index);
+
+// Moves every colour along the palette by steps entries, wrapping round
+// at the ends. Cycling a palette that doesn't wrap on its own gives a seam
+void brot_palette_cycle(Brot_Palette *palette, int steps);
+
+void brot_palette_free(Brot_Palette *palette);
+
+// How many bins the histogram for a frame with this many iterations needs
+int brot_histogram_bins(int repeats);
+
+// Counts the pixels that escaped into a histogram with brot_histogram_bins bins
+void brot_histogram_add(uint64_t *counts, int repeats, const int *raw, int count);
+
+// Sets up a scale that spreads the values evenly between the lowest and highest
+void brot_colour_scale_linear(Brot_Colour_Scale *scale, double highest, double lowest);
+
+// Sets up a scale that gives each part of the palette the same number of
+// pixels, from the histogram of the whole frame
+void brot_colour_scale_histogram(Brot_Colour_Scale *scale, const uint64_t *counts, int repeats);
+
+void brot_colour_scale_free(Brot_Colour_Scale *scale);
+
+// The colour for one smooth value. Anything under the lowest value, like
+// the pixels inside the set, is black
+uint32_t brot_palette_colour(const Brot_Palette *palette, const Brot_Colour_Scale *scale, double value);
+
+// Colours count pixels from their raw and fraction values the same as
+// brot_palette_colour, with gathers from the tables when the instruction
+// set has them
+void brot_palette_span(const Brot_Palette *palette, Brot_ISA isa, const Brot_Colour_Scale *scale, int repeats,
+                       const int *raw, const uint16_t *fraction, uint32_t *colours, int count);
+
+#endif
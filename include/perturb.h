@@ -0,0 +1,79 @@
+#ifndef PERTURB_H
+#define PERTURB_H
+
+#include "mandelbrot.h"
+#include "fixed.h"
+
+// Pixels closer together than this are calculated by perturbation,
+// around a reference orbit worked out at full precision.
+// Double-doubles could go a bit further, but by here the iteration
+// counts are high enough that skipping through the approximation table wins
+#define BROT_DEEP_SPACING 1e-20
+
+// How small the squared term has to be next to the linear one
+// before it is left out of the approximation table.
+// Anything bigger than a double's rounding shows up near the edge of the set,
+// where the orbits are sensitive enough to blow it up
+#define BROT_BLA_EPSILON 0x1p-53
+
+// Most levels the approximation table can have, each one skips
+// twice as many iterations as the level below it
+#define BROT_BLA_MAX_LEVELS 32
+
+// One step of the approximation table. While the offset is smaller than
+// radius the next skip iterations of the offset come down to
+// dz -> A dz + B dc, as the squared term is too small to matter
+typedef struct brot_bla {
+    double ax, ay;
+    double bx, by;
+    double radius;
+    int skip;
+} Brot_Bla;
+
+// The orbit of the point at the centre of the view, worked out with
+// fixed point numbers and then rounded to doubles.
+// Every pixel is iterated as a small offset from this orbit
+typedef struct brot_reference {
+
+    // Z_0 = 0 up to Z_length
+    double *x;
+    double *y;
+
+    // Number of iterations before the reference escaped, or repeats
+    int length;
+
+    // What the orbit was calculated for, so it is only redone when needed
+    Brot_Fixed cx;
+    Brot_Fixed cy;
+    int repeats;
+    int valid;
+
+    // Bilinear approximations of the orbit. Level k entry j starts at
+    // iteration 1 + j 2^k and covers up to 2^k iterations.
+    // There are none for iteration 0 as the orbit starts at zero
+    Brot_Bla *bla[BROT_BLA_MAX_LEVELS];
+    int blaCount[BROT_BLA_MAX_LEVELS];
+    int blaLevels;
+
+    // The biggest offset of any pixel the table was made for,
+    // the radii depend on it so it is rebuilt when the view changes size
+    double blaOffset;
+
+} Brot_Reference;
+
+// Makes sure the brot's reference orbit is for the centre of the current view,
+// and that its approximation table suits the size of the view
+void brot_reference_update(Mandelbrot brot);
+
+void brot_reference_cleanup(Brot_Reference *reference);
+
+// Iterates each pixel as an offset from the reference orbit, in doubles.
+// When a pixel's orbit gets closer to zero than it is to the reference
+// the offsets lose their precision and the image glitches. Those pixels
+// are caught and rebased onto the start of the reference orbit,
+// which also covers running past the end of a reference that escaped.
+// Where the approximation table allows it whole runs of iterations are
+// skipped at once rather than iterated one at a time
+void brot_kernel_perturb(Mandelbrot brot, int xPos, int yPos, int count, int step, uint16_t *fraction, int *raw);
+
+#endif
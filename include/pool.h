@@ -0,0 +1,78 @@
+#ifndef POOL_H
+#define POOL_H
+
+#include <pthread.h>
+
+// The work each thread runs when the pool is started
+// Gets the shared argument and the index of the thread running it
+typedef void (*Pool_Task)(void *arg, int thread);
+
+typedef struct thread_pool *Pool;
+typedef struct thread_pool {
+
+    // The worker threads, created once and reused for every job
+    pthread_t *threads;
+    int count;
+
+    pthread_mutex_t lock;
+
+    // Signalled when a new job is ready and when all threads have finished it
+    pthread_cond_t start;
+    pthread_cond_t done;
+
+    // The job that is currently being run
+    Pool_Task task;
+    void *arg;
+
+    // Bumped for every job so the threads know there is new work
+    unsigned long generation;
+
+    // Number of threads that have not yet finished the current job
+    int pending;
+
+    int shutdown;
+
+} Pool_Data;
+
+// A double ended queue of work item numbers, one for each thread.
+// The thread it belongs to adds and takes items at the bottom, newest first,
+// and threads that have run out of work steal from the top, oldest first,
+// so they take the work furthest from what the owner is doing
+typedef struct pool_deque {
+    pthread_mutex_t lock;
+
+    int *items;
+    int capacity;
+
+    // The items waiting are the ones from top up to but not including bottom
+    int top;
+    int bottom;
+} Pool_Deque;
+
+// Create a pool with the given number of threads
+// A count of zero or less uses one thread per online CPU
+Pool pool_create(int count);
+
+// Run the task on every thread in the pool and wait until they all return
+void pool_run(Pool pool, Pool_Task task, void *arg);
+
+// Stop all the threads and free the pool
+void pool_cleanup(Pool pool);
+
+// Sets up an empty deque. Capacity has to cover every item
+// that will be pushed onto it before it is next empty
+void pool_deque_init(Pool_Deque *deque, int capacity);
+
+void pool_deque_free(Pool_Deque *deque);
+
+void pool_deque_push(Pool_Deque *deque, int item);
+
+// These give back -1 if the deque is empty
+int pool_deque_pop(Pool_Deque *deque);
+int pool_deque_steal(Pool_Deque *deque);
+
+// Whether there's nothing waiting. Other threads can steal from
+// it at any time, so it may be empty soon after saying it isn't
+int pool_deque_empty(Pool_Deque *deque);
+
+#endif
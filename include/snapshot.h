@@ -0,0 +1,39 @@
+#ifndef SNAPSHOT_H
+#define SNAPSHOT_H
+
+#include "mandelbrot.h"
+
+// Creates a snapshot with planes sized for the brot, with one reference
+Brot_Snapshot *brot_snapshot_create(Mandelbrot brot);
+
+// Gets a snapshot that can be written to, reusing the spare if there is one
+Brot_Snapshot *brot_snapshot_get(Mandelbrot brot);
+
+// Frees the snapshot and its planes whatever its reference count
+void brot_snapshot_free(Brot_Snapshot *snapshot);
+
+void brot_snapshot_retain(Brot_Snapshot *snapshot);
+
+// Drops a reference, once there are none left the snapshot
+// becomes the brot's spare or is freed
+void brot_snapshot_release(Mandelbrot brot, Brot_Snapshot *snapshot);
+
+// Records the brot's current view and settings in the snapshot
+void brot_snapshot_stamp(Mandelbrot brot, Brot_Snapshot *snapshot);
+
+// Checks if the snapshot was calculated with the brot's current settings
+int brot_snapshot_matches(Mandelbrot brot, Brot_Snapshot *snapshot);
+
+// Makes the snapshot the current one, taking over the caller's reference
+// and dropping the reference to the old current snapshot
+void brot_snapshot_use(Mandelbrot brot, Brot_Snapshot *snapshot);
+
+// Keeps a reference to the current snapshot on the zoom history
+// Once the history is full the oldest entry is dropped
+void brot_history_push(Mandelbrot brot);
+
+// Takes the newest snapshot off the history, along with its reference
+// Gives back NULL if the history is empty
+Brot_Snapshot *brot_history_pop(Mandelbrot brot);
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef SUBDIVIDE_H
+#define SUBDIVIDE_H
+
+#include "mandelbrot.h"
+
+// Rectangles this size or smaller are calculated pixel by pixel
+// instead of being split again
+#define BROT_SUBDIVIDE_MIN 6
+
+// Fills in the fraction and raw values for the pixels from xStart to xEnd
+// and yStart to yEnd using Mariani-Silver subdivision
+// brot->render_mode picks which rectangles can be filled without iterating
+void brot_subdivide_tile(Mandelbrot brot, int xStart, int yStart, int xEnd, int yEnd);
+
+#endif
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "main.h"
+#include "palette.h"
+
+// Checks the palette is one of the built in ones, listing them if it isn't
+static void check_palette(const char *name)
+{
+    const char *builtin;
+
+    for (int i = 0; (builtin = brot_palette_name(i)) != NULL; i++) {
+        if (strcmp(builtin, name) == 0) {
+            return;
+        }
+    }
+
+    printf("There's no palette called %s, the palettes are:", name);
+    for (int i = 0; (builtin = brot_palette_name(i)) != NULL; i++) {
+        printf(" %s", builtin);
+    }
+    printf("\n");
+
+    usage(1);
+}
+
+static void check_colouring(const char *name)
+{
+    if (strcmp(name, brot_colouring_name(BROT_COLOUR_HISTOGRAM)) != 0 &&
+        strcmp(name, brot_colouring_name(BROT_COLOUR_LINEAR)) != 0) {
+        printf("The colouring has to be %s or %s\n",
+               brot_colouring_name(BROT_COLOUR_HISTOGRAM), brot_colouring_name(BROT_COLOUR_LINEAR));
+        usage(1);
+    }
+}
+
+// Set by parse_args, the viewer takes fewer options than the headless renderer
+static int headless_options = 1;
+
+void usage(int exitval) {
+    printf("Mandelbrot usage:\n");
+    if (headless_options) {
+        printf("mandelbrot [-w width] [-h height] [-i iterations] [-v x1,y1,x2,y2]\n");
+        printf("           [-c centre_x,centre_y -s view_width] [-p palette]\n");
+        printf("           [-e histogram|linear]\n");
+        printf("           [-d workers] [-m scratch_directory] outputfile\n");
+    } else {
+        printf("mandelbrot [-i iterations] [-v x1,y1,x2,y2] [-p palette]\n");
+        printf("           [-e histogram|linear] outputfile\n");
+    }
+    exit(exitval);
+}
+
+Args parse_args(int argc, char *argv[], int headless) {
+
+    Args args = {1920, 1080, 255, -2.5, -1.0, 1.0, 1.0, NULL, NULL, 3.5, NULL, NULL, 0, NULL, ""};
+
+    char *comma;
+
+    int c;
+
+    // The viewer always fills the screen and calculates everything itself,
+    // so anything else is left for getopt to turn down
+    headless_options = headless;
+    const char *options = headless ? "w:h:i:v:c:s:p:e:d:m:" : "i:v:p:e:";
+
+    while ( (c = getopt(argc, argv, options)) != -1) {
+        switch (c)
+        {
+            case 'w':
+                args.width = atoi(optarg);
+                break;
+            case 'h':
+                args.height = atoi(optarg);
+                break;
+            case 'i':
+                args.repeats = atoi(optarg);
+                break;
+            case 'v':
+                if (sscanf(optarg, "%lf,%lf,%lf,%lf", &args.x1, &args.y1, &args.x2, &args.y2) != 4) {
+                    printf("The view needs four coordinates\n");
+                    usage(1);
+                }
+                break;
+            case 'c':
+                // Kept as strings so none of the precision is lost
+                comma = strchr(optarg, ',');
+                if (comma == NULL) {
+                    printf("The centre needs two coordinates\n");
+                    usage(1);
+                }
+                *comma = '\0';
+                args.centerX = optarg;
+                args.centerY = comma + 1;
+                break;
+            case 's':
+                args.width_span = atof(optarg);
+                break;
+            case 'p':
+                check_palette(optarg);
+                args.palette = optarg;
+                break;
+            case 'e':
+                check_colouring(optarg);
+                args.colouring = optarg;
+                break;
+            case 'd':
+                args.workers = atoi(optarg);
+                break;
+            case 'm':
+                args.mapped_dir = optarg;
+                break;
+            default:
+                usage(1);
+                break;
+        }
+    }
+
+    if (args.workers < 0) {
+        printf("The number of workers can't be negative\n");
+        usage(1);
+    }
+
+    if (args.workers > 0 && args.mapped_dir != NULL) {
+        printf("Worker processes can't be used with mapped planes\n");
+        usage(1);
+    }
+
+    if (args.width <= 0 || args.height <= 0 || args.repeats <= 0) {
+        printf("Width, height and iterations must be positive\n");
+        usage(1);
+    }
+
+    if (optind < argc) {
+        args.output_file = argv[optind];
+    }
+
+    if (*args.output_file == '\0') {
+        printf("Need to specify an output file\n");
+        usage(1);
+    } else {
+        printf("Writing images to %s\n", args.output_file);
+    }
+
+    return args;
+}
@@ -0,0 +1,406 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <sys/wait.h>
+
+#include "mandelbrot.h"
+#include "distribute.h"
+#include "snapshot.h"
+#include "fixed.h"
+
+// Everything a worker needs to set up the same view as the coordinator
+typedef struct brot_job_view {
+    int width;
+    int height;
+    int repeats;
+    int interior_check;
+    int periodicity_check;
+
+    double x1, y1, x2, y2;
+    double spanX, spanY;
+
+    Brot_Fixed centerX;
+    Brot_Fixed centerY;
+} Brot_Job_View;
+
+// A rectangle of pixels to calculate, the same as brot_compute_region takes
+// A job with nothing in it tells the worker to stop
+// The result goes back as the job followed by the fraction values
+// and then the raw values, a row at a time with no padding
+typedef struct brot_job {
+    int xStart;
+    int yStart;
+    int xEnd;
+    int yEnd;
+} Brot_Job;
+
+// The coordinator's side of a worker
+typedef struct brot_worker {
+    pid_t pid;
+    int fd;
+
+    // The jobs sent and not yet answered, oldest first
+    Brot_Job sent[BROT_JOBS_IN_FLIGHT];
+    int inFlight;
+} Brot_Worker;
+
+typedef struct brot_worker_set {
+    Brot_Worker *workers;
+    int count;
+} Brot_Worker_Set;
+
+static int brot_read_all(int fd, void *data, size_t size)
+{
+    char *bytes = (char*) data;
+    ssize_t done;
+
+    while (size > 0) {
+        done = read(fd, bytes, size);
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            return 0;
+        }
+        bytes += done;
+        size -= done;
+    }
+
+    return 1;
+}
+
+static int brot_write_all(int fd, const void *data, size_t size)
+{
+    const char *bytes = (const char*) data;
+    ssize_t done;
+
+    while (size > 0) {
+        // Not raising SIGPIPE if the other end has gone
+        done = send(fd, bytes, size, MSG_NOSIGNAL);
+        if (done < 0 && errno == EINTR) {
+            continue;
+        }
+        if (done <= 0) {
+            return 0;
+        }
+        bytes += done;
+        size -= done;
+    }
+
+    return 1;
+}
+
+int brot_worker_run(int fd, int threads)
+{
+    Brot_Job_View view;
+    Brot_Job job;
+
+    if (!brot_read_all(fd, &view, sizeof(view))) {
+        return 1;
+    }
+
+    // Several workers share the machine, so each only gets its share of it
+    Mandelbrot brot = brot_create_threads(view.width, view.height, view.repeats,
+                                          view.x1, view.y1, view.x2, view.y2, threads);
+
+    brot->interior_check = view.interior_check;
+    brot->periodicity_check = view.periodicity_check;
+
+    brot->spanX = view.spanX;
+    brot->spanY = view.spanY;
+    brot->centerX = view.centerX;
+    brot->centerY = view.centerY;
+
+    brot_select_kernel(brot);
+
+    // The brot's own planes are never touched so they never get any
+    // memory behind them, the values go through these instead
+    uint16_t *fraction = (uint16_t*) malloc(sizeof(uint16_t) * BROT_JOB_SIZE * BROT_JOB_SIZE);
+    int *raw = (int*) malloc(sizeof(int) * BROT_JOB_SIZE * BROT_JOB_SIZE);
+
+    int status = 1;
+
+    while (brot_read_all(fd, &job, sizeof(job))) {
+
+        int width = job.xEnd - job.xStart;
+        int height = job.yEnd - job.yStart;
+
+        if (width <= 0 || height <= 0) {
+            status = 0;
+            break;
+        }
+
+        brot_compute_region(brot, job.xStart, job.yStart, job.xEnd, job.yEnd, fraction, raw, width);
+
+        if (!brot_write_all(fd, &job, sizeof(job)) ||
+            !brot_write_all(fd, fraction, sizeof(uint16_t) * width * height) ||
+            !brot_write_all(fd, raw, sizeof(int) * width * height)) {
+            break;
+        }
+    }
+
+    free(fraction);
+    free(raw);
+
+    brot_cleanup(brot);
+
+    return status;
+}
+
+// Gets the bounds of a job, clipped to the edges of the image
+static Brot_Job brot_job_bounds(Mandelbrot brot, int index, int jobsX)
+{
+    Brot_Job job;
+
+    job.xStart = (index % jobsX) * BROT_JOB_SIZE;
+    job.yStart = (index / jobsX) * BROT_JOB_SIZE;
+
+    job.xEnd = job.xStart + BROT_JOB_SIZE;
+    job.yEnd = job.yStart + BROT_JOB_SIZE;
+
+    if (job.xEnd > brot->pixelWidth) {
+        job.xEnd = brot->pixelWidth;
+    }
+    if (job.yEnd > brot->pixelHeight) {
+        job.yEnd = brot->pixelHeight;
+    }
+
+    return job;
+}
+
+// Reads a worker's answer to its oldest job straight into the planes
+static int brot_receive_result(Mandelbrot brot, Brot_Worker *worker)
+{
+    Brot_Job job;
+    int width, height;
+
+    if (!brot_read_all(worker->fd, &job, sizeof(job))) {
+        return 0;
+    }
+
+    if (memcmp(&job, &worker->sent[0], sizeof(job)) != 0) {
+        return 0;
+    }
+
+    width = job.xEnd - job.xStart;
+    height = job.yEnd - job.yStart;
+
+    for (int row = 0; row < height; row++) {
+        if (!brot_read_all(worker->fd, brot->fraction_values + (job.yStart + row) * brot->stride + job.xStart,
+                           sizeof(uint16_t) * width)) {
+            return 0;
+        }
+    }
+
+    for (int row = 0; row < height; row++) {
+        if (!brot_read_all(worker->fd, brot->raw_values + (job.yStart + row) * brot->stride + job.xStart,
+                           sizeof(int) * width)) {
+            return 0;
+        }
+    }
+
+    worker->inFlight--;
+    memmove(&worker->sent[0], &worker->sent[1], sizeof(Brot_Job) * worker->inFlight);
+
+    return 1;
+}
+
+// Starts the workers, each on its own socket pair. Gives back how many started
+static int brot_start_workers(Brot_Worker *workers, int count, int threads)
+{
+    int fds[2];
+
+    for (int i = 0; i < count; i++) {
+
+        if (socketpair(AF_UNIX, SOCK_STREAM, 0, fds) != 0) {
+            return i;
+        }
+
+        // Anything still buffered would be printed twice
+        fflush(stdout);
+
+        pid_t pid = fork();
+
+        if (pid < 0) {
+            close(fds[0]);
+            close(fds[1]);
+            return i;
+        }
+
+        if (pid == 0) {
+            // The worker doesn't need the coordinator's ends of any socket
+            for (int other = 0; other < i; other++) {
+                close(workers[other].fd);
+            }
+            close(fds[0]);
+
+            _exit(brot_worker_run(fds[1], threads));
+        }
+
+        close(fds[1]);
+
+        workers[i].pid = pid;
+        workers[i].fd = fds[0];
+        workers[i].inFlight = 0;
+    }
+
+    return count;
+}
+
+static void brot_stop_workers(Brot_Worker *workers, int count, int failed)
+{
+    Brot_Job stop = {0, 0, 0, 0};
+
+    for (int i = 0; i < count; i++) {
+        if (failed) {
+            kill(workers[i].pid, SIGTERM);
+        } else {
+            brot_write_all(workers[i].fd, &stop, sizeof(stop));
+        }
+        close(workers[i].fd);
+    }
+
+    for (int i = 0; i < count; i++) {
+        waitpid(workers[i].pid, NULL, 0);
+    }
+}
+
+void brot_workers_stop(Brot_Workers set)
+{
+    brot_stop_workers(set->workers, set->count, 1);
+
+    free(set->workers);
+    free(set);
+}
+
+Brot_Workers brot_workers_start(int count)
+{
+    Brot_Workers set = (Brot_Workers) malloc(sizeof(Brot_Worker_Set));
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = cpus > count ? (int)(cpus / count) : 1;
+
+    set->workers = (Brot_Worker*) malloc(sizeof(Brot_Worker) * count);
+    set->count = brot_start_workers(set->workers, count, threads);
+
+    if (set->count < count) {
+        printf("Could only start %d of %d workers\n", set->count, count);
+        brot_workers_stop(set);
+        return NULL;
+    }
+
+    return set;
+}
+
+Mandelbrot brot_distribute(Mandelbrot brot, Brot_Workers set)
+{
+    Brot_Worker *workers = set->workers;
+    int workerCount = set->count;
+
+    struct pollfd *polls = (struct pollfd*) malloc(sizeof(struct pollfd) * workerCount);
+
+    Brot_Job_View view;
+
+    int jobsX = (brot->pixelWidth + BROT_JOB_SIZE - 1) / BROT_JOB_SIZE;
+    int jobsY = (brot->pixelHeight + BROT_JOB_SIZE - 1) / BROT_JOB_SIZE;
+    int jobCount = jobsX * jobsY;
+
+    int nextJob = 0;
+    int finished = 0;
+    int failed = 0;
+
+    // Only for reporting, the workers pick their own kernels
+    brot_pick_precision(brot);
+
+    memset(&view, 0, sizeof(view));
+    view.width = brot->pixelWidth;
+    view.height = brot->pixelHeight;
+    view.repeats = brot->repeats;
+    view.interior_check = brot->interior_check;
+    view.periodicity_check = brot->periodicity_check;
+    view.x1 = brot->x1;
+    view.y1 = brot->y1;
+    view.x2 = brot->x2;
+    view.y2 = brot->y2;
+    view.spanX = brot->spanX;
+    view.spanY = brot->spanY;
+    view.centerX = brot->centerX;
+    view.centerY = brot->centerY;
+
+    // The planes are about to be written over
+    if (brot->current->refs > 1) {
+        brot_snapshot_use(brot, brot_snapshot_get(brot));
+    }
+
+    for (int i = 0; i < workerCount && !failed; i++) {
+        failed = !brot_write_all(workers[i].fd, &view, sizeof(view));
+    }
+
+    while (finished < jobCount && !failed) {
+
+        // Keep every worker topped up
+        for (int i = 0; i < workerCount && !failed; i++) {
+            while (workers[i].inFlight < BROT_JOBS_IN_FLIGHT && nextJob < jobCount) {
+                Brot_Job job = brot_job_bounds(brot, nextJob, jobsX);
+
+                if (!brot_write_all(workers[i].fd, &job, sizeof(job))) {
+                    failed = 1;
+                    break;
+                }
+
+                workers[i].sent[workers[i].inFlight++] = job;
+                nextJob++;
+            }
+
+            polls[i].fd = workers[i].fd;
+            polls[i].events = workers[i].inFlight > 0 ? POLLIN : 0;
+            polls[i].revents = 0;
+        }
+
+        if (failed) {
+            break;
+        }
+
+        if (poll(polls, workerCount, -1) < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            failed = 1;
+            break;
+        }
+
+        for (int i = 0; i < workerCount; i++) {
+            if (polls[i].revents == 0) {
+                continue;
+            }
+
+            if (!brot_receive_result(brot, &workers[i])) {
+                printf("Worker %d stopped before finishing its jobs\n", i);
+                failed = 1;
+                break;
+            }
+
+            finished++;
+        }
+    }
+
+    brot_stop_workers(workers, workerCount, failed);
+
+    free(workers);
+    free(set);
+    free(polls);
+
+    if (failed) {
+        return NULL;
+    }
+
+    brot->reused_pixels = 0;
+
+    return brot_smooth_colour(brot);
+}
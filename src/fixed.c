@@ -0,0 +1,291 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <stdint.h>
+
+#include "fixed.h"
+
+// The magnitude helpers all work on the first n limbs, most significant first
+
+static int brot_mag_cmp(const uint32_t *a, const uint32_t *b, int n)
+{
+    for (int i = 0; i < n; i++) {
+        if (a[i] != b[i]) {
+            return a[i] > b[i] ? 1 : -1;
+        }
+    }
+    return 0;
+}
+
+static void brot_mag_add(uint32_t *out, const uint32_t *a, const uint32_t *b, int n)
+{
+    uint64_t carry = 0;
+
+    for (int i = n - 1; i >= 0; i--) {
+        uint64_t sum = (uint64_t)a[i] + b[i] + carry;
+        out[i] = (uint32_t)sum;
+        carry = sum >> 32;
+    }
+}
+
+// a has to be at least as big as b
+static void brot_mag_sub(uint32_t *out, const uint32_t *a, const uint32_t *b, int n)
+{
+    int64_t borrow = 0;
+
+    for (int i = n - 1; i >= 0; i--) {
+        int64_t diff = (int64_t)a[i] - b[i] - borrow;
+        borrow = diff < 0;
+        out[i] = (uint32_t)(diff + (borrow << 32));
+    }
+}
+
+// Clears the limbs past the precision and makes sure zero is never negative
+static void brot_fixed_tidy(Brot_Fixed *value)
+{
+    int zero = 1;
+
+    for (int i = value->limbs; i < BROT_FIXED_MAX_LIMBS; i++) {
+        value->limb[i] = 0;
+    }
+
+    for (int i = 0; i < value->limbs; i++) {
+        if (value->limb[i] != 0) {
+            zero = 0;
+            break;
+        }
+    }
+
+    if (zero) {
+        value->sign = 1;
+    }
+}
+
+static int brot_fixed_clamp_limbs(int limbs)
+{
+    if (limbs < BROT_FIXED_MIN_LIMBS) {
+        return BROT_FIXED_MIN_LIMBS;
+    }
+    if (limbs > BROT_FIXED_MAX_LIMBS) {
+        return BROT_FIXED_MAX_LIMBS;
+    }
+    return limbs;
+}
+
+void brot_fixed_from_double(Brot_Fixed *out, double value, int limbs)
+{
+    double whole;
+
+    memset(out, 0, sizeof(Brot_Fixed));
+
+    out->limbs = brot_fixed_clamp_limbs(limbs);
+    out->sign = value < 0 ? -1 : 1;
+
+    value = fabs(value);
+
+    whole = floor(value);
+    out->limb[0] = (uint32_t)whole;
+    value -= whole;
+
+    // Multiplying by 2^32 is exact so this takes every bit of the double
+    for (int i = 1; i < out->limbs && value > 0; i++) {
+        value = ldexp(value, 32);
+        whole = floor(value);
+        out->limb[i] = (uint32_t)whole;
+        value -= whole;
+    }
+
+    brot_fixed_tidy(out);
+}
+
+int brot_fixed_from_string(Brot_Fixed *out, const char *text, int limbs)
+{
+    const char *digits;
+    const char *end;
+    uint32_t whole = 0;
+    int sign = 1;
+
+    memset(out, 0, sizeof(Brot_Fixed));
+    out->limbs = brot_fixed_clamp_limbs(limbs);
+    out->sign = 1;
+
+    if (*text == '-') {
+        sign = -1;
+        text++;
+    } else if (*text == '+') {
+        text++;
+    }
+
+    if (*text < '0' || *text > '9') {
+        if (!(*text == '.' && text[1] >= '0' && text[1] <= '9')) {
+            return 0;
+        }
+    }
+
+    while (*text >= '0' && *text <= '9') {
+        whole = whole * 10 + (*text - '0');
+        text++;
+    }
+
+    if (*text == '.') {
+        text++;
+        digits = text;
+        while (*text >= '0' && *text <= '9') {
+            text++;
+        }
+        end = text;
+
+        // Work back from the last digit, each one shifts
+        // everything after it one decimal place down
+        for (const char *d = end - 1; d >= digits; d--) {
+            out->limb[0] = *d - '0';
+            brot_fixed_div_small(out, 10);
+        }
+    }
+
+    if (*text != '\0') {
+        return 0;
+    }
+
+    out->limb[0] = whole;
+    out->sign = sign;
+
+    brot_fixed_tidy(out);
+
+    return 1;
+}
+
+double brot_fixed_to_double(const Brot_Fixed *value)
+{
+    double result = 0;
+    int first = 0;
+
+    while (first < value->limbs && value->limb[first] == 0) {
+        first++;
+    }
+
+    // Three limbs from the first one that's set are more than a double can hold
+    for (int i = first; i < value->limbs && i < first + 3; i++) {
+        result += ldexp((double)value->limb[i], -32 * i);
+    }
+
+    return value->sign * result;
+}
+
+void brot_fixed_to_dd(const Brot_Fixed *value, Brot_DD *out)
+{
+    Brot_Fixed rest;
+
+    out->hi = brot_fixed_to_double(value);
+
+    brot_fixed_from_double(&rest, out->hi, value->limbs);
+    brot_fixed_sub(&rest, value, &rest);
+
+    out->lo = brot_fixed_to_double(&rest);
+}
+
+void brot_fixed_set_limbs(Brot_Fixed *value, int limbs)
+{
+    value->limbs = brot_fixed_clamp_limbs(limbs);
+    brot_fixed_tidy(value);
+}
+
+void brot_fixed_add(Brot_Fixed *out, const Brot_Fixed *a, const Brot_Fixed *b)
+{
+    int n = a->limbs > b->limbs ? a->limbs : b->limbs;
+    int sign;
+
+    if (a->sign == b->sign) {
+        brot_mag_add(out->limb, a->limb, b->limb, n);
+        sign = a->sign;
+    } else if (brot_mag_cmp(a->limb, b->limb, n) >= 0) {
+        brot_mag_sub(out->limb, a->limb, b->limb, n);
+        sign = a->sign;
+    } else {
+        brot_mag_sub(out->limb, b->limb, a->limb, n);
+        sign = b->sign;
+    }
+
+    out->sign = sign;
+    out->limbs = n;
+
+    brot_fixed_tidy(out);
+}
+
+void brot_fixed_sub(Brot_Fixed *out, const Brot_Fixed *a, const Brot_Fixed *b)
+{
+    Brot_Fixed negated = *b;
+
+    negated.sign = -negated.sign;
+
+    brot_fixed_add(out, a, &negated);
+}
+
+void brot_fixed_mul(Brot_Fixed *out, const Brot_Fixed *a, const Brot_Fixed *b)
+{
+    int n = a->limbs > b->limbs ? a->limbs : b->limbs;
+
+    // One extra limb below the precision so the truncation
+    // only ever affects the last bit
+    uint32_t product[BROT_FIXED_MAX_LIMBS + 1];
+    unsigned __int128 carry = 0;
+
+    for (int k = n; k >= 0; k--) {
+        unsigned __int128 column = carry;
+        int first = k > n - 1 ? k - (n - 1) : 0;
+
+        for (int i = first; i <= k && i < n; i++) {
+            column += (uint64_t)a->limb[i] * b->limb[k - i];
+        }
+
+        product[k] = (uint32_t)column;
+        carry = column >> 32;
+    }
+
+    out->sign = a->sign * b->sign;
+    out->limbs = n;
+
+    memcpy(out->limb, product, sizeof(uint32_t) * n);
+
+    brot_fixed_tidy(out);
+}
+
+void brot_fixed_add_double(Brot_Fixed *value, double add)
+{
+    Brot_Fixed other;
+
+    brot_fixed_from_double(&other, add, value->limbs);
+    brot_fixed_add(value, value, &other);
+}
+
+void brot_fixed_div_small(Brot_Fixed *value, uint32_t divisor)
+{
+    uint64_t remainder = 0;
+
+    for (int i = 0; i < value->limbs; i++) {
+        uint64_t current = (remainder << 32) | value->limb[i];
+        value->limb[i] = (uint32_t)(current / divisor);
+        remainder = current % divisor;
+    }
+
+    brot_fixed_tidy(value);
+}
+
+int brot_fixed_equal(const Brot_Fixed *a, const Brot_Fixed *b)
+{
+    int n = a->limbs > b->limbs ? a->limbs : b->limbs;
+
+    return a->sign == b->sign && brot_mag_cmp(a->limb, b->limb, n) == 0;
+}
+
+int brot_fixed_limbs_for(double spacing)
+{
+    if (!(spacing > 0)) {
+        return BROT_FIXED_MAX_LIMBS;
+    }
+
+    double bits = -log2(spacing) + 64;
+
+    return brot_fixed_clamp_limbs(1 + (int)ceil(bits / 32));
+}
@@ -0,0 +1,105 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "main.h"
+#include "mandelbrot.h"
+#include "kernel.h"
+#include "distribute.h"
+#include "mapped.h"
+#include "image.h"
+
+// Shows how evenly the work was spread over the threads
+void print_load_balance(Mandelbrot brot)
+{
+    double least = 1.0, most = 0.0, share;
+    int steals = 0;
+
+    for (int thread = 0; thread < brot->thread_count; thread++) {
+        Brot_Thread_Stats *stats = &brot->thread_stats[thread];
+
+        share = stats->busy + stats->idle > 0 ? stats->busy / (stats->busy + stats->idle) : 1.0;
+
+        if (share < least) {
+            least = share;
+        }
+        if (share > most) {
+            most = share;
+        }
+        steals += stats->steals;
+    }
+
+    printf("%d threads were busy from %.0f%% to %.0f%% of the time, with %d pieces stolen\n",
+           brot->thread_count, least * 100, most * 100, steals);
+}
+
+// Renders a single image straight to a file, without opening a window
+int main(int argc, char* argv[])
+{
+    Args args = parse_args(argc, argv, 1);
+
+    Brot_Workers workers = NULL;
+
+    // Forked before brot_create starts any threads
+    if (args.workers > 0) {
+        workers = brot_workers_start(args.workers);
+        if (workers == NULL) {
+            return 1;
+        }
+    }
+
+    Mandelbrot brot = brot_create(args.width, args.height, args.repeats, args.x1, args.y1, args.x2, args.y2);
+
+    if (args.centerX != NULL && brot_set_view(brot, args.centerX, args.centerY, args.width_span) == NULL) {
+        printf("Couldn't read the centre %s,%s\n", args.centerX, args.centerY);
+        if (workers != NULL) {
+            brot_workers_stop(workers);
+        }
+        brot_cleanup(brot);
+        return 1;
+    }
+
+    if (args.palette != NULL) {
+        brot_set_palette(brot, args.palette);
+    }
+
+    if (args.colouring != NULL) {
+        brot_set_colouring(brot, args.colouring);
+    }
+
+    // Too big for memory, so it's calculated and written out a band at a time
+    if (args.mapped_dir != NULL) {
+        unsigned err = brot_render_mapped(brot, args.mapped_dir, args.output_file);
+
+        if (!err) {
+            printf("Calculated in %s precision with the %s kernels\n",
+                   brot_precision_name(brot->precision), brot_isa_name(brot->isa));
+        }
+
+        brot_cleanup(brot);
+
+        return err ? 1 : 0;
+    }
+
+    if (workers != NULL) {
+        if (brot_distribute(brot, workers) == NULL) {
+            brot_cleanup(brot);
+            return 1;
+        }
+    } else {
+        brot_smooth_calculate(brot);
+    }
+
+    printf("Calculated in %s precision with the %s kernels\n",
+           brot_precision_name(brot->precision), brot_isa_name(brot->isa));
+
+    // The workers' threads are out of sight
+    if (args.workers == 0) {
+        print_load_balance(brot);
+    }
+
+    unsigned err = render_png(brot, args.output_file);
+
+    brot_cleanup(brot);
+
+    return err ? 1 : 0;
+}
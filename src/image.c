@@ -0,0 +1,55 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "mandelbrot.h"
+#include "image.h"
+#include "lodepng.h"
+
+void render_png_scanline(const uint32_t *colours, unsigned char *scanline, int width)
+{
+    uint32_t colour;
+
+    for (int x = 0; x < width; x++) {
+        colour = colours[x];
+        scanline[3 * (size_t)x + 0] = (colour >> 16) & 255;
+        scanline[3 * (size_t)x + 1] = (colour >> 8)  & 255;
+        scanline[3 * (size_t)x + 2] = (colour)       & 255;
+    }
+}
+
+unsigned render_png(Mandelbrot brot, char* output_file)
+{
+    int width  = brot->pixelWidth;
+    int height = brot->pixelHeight;
+
+    LodePNGStream *stream;
+    unsigned err;
+
+    // Only a row at a time is converted, the encoder compresses and
+    // writes them as it goes so the image is never copied whole
+    unsigned char* scanline = malloc((size_t)width * 3);
+
+    err = lodepng_stream_open(&stream, output_file, width, height);
+
+    for (int y = 0; y < height && !err; y++) {
+        render_png_scanline(brot->canvas + (size_t)y * brot->stride, scanline, width);
+
+        err = lodepng_stream_push(stream, scanline);
+    }
+
+    if (stream != NULL) {
+        unsigned closeErr = lodepng_stream_close(stream);
+        if (!err) {
+            err = closeErr;
+        }
+    }
+
+    if (err) {
+        printf("error %u: %s\n", err, lodepng_error_text(err));
+    }
+
+    free(scanline);
+
+    return err;
+}
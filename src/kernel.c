@@ -0,0 +1,809 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <math.h>
+#include <stdint.h>
+
+#include "mandelbrot.h"
+#include "kernel.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BROT_X86
+#endif
+
+void brot_kernel_scalar(Mandelbrot brot, int xPos, int yPos, int count, int step, uint16_t *fraction, int *raw)
+{
+    for (int i = 0; i < count; i++) {
+        double smooth = brot_calc_escape(brot, xPos + i * step, yPos, &raw[i]);
+        fraction[i] = brot_fraction_pack(raw[i], smooth);
+    }
+}
+
+// Works out the real part of c for count pixels step apart along a row,
+// in doubles so the float kernels only round each coordinate once
+static void brot_row_coords(Mandelbrot brot, int xPos, int count, int step, float *cx)
+{
+    for (int i = 0; i < count; i++) {
+        cx[i] = (float)(brot->x1 + (brot->x2 - brot->x1) * ((double)(xPos + i * step) / brot->pixelWidth));
+    }
+}
+
+static double brot_row_imaginary(Mandelbrot brot, int yPos)
+{
+    return (double)brot->y1 - ((brot->y1 - brot->y2) * ((double)yPos / brot->pixelHeight));
+}
+
+void brot_kernel_scalar_float(Mandelbrot brot, int xPos, int yPos, int count, int step, uint16_t *fraction, int *raw)
+{
+    double yCoord = brot_row_imaginary(brot, yPos);
+    float epsilon = (float)brot_period_epsilon(brot);
+    float cy = (float)yCoord;
+    float cx;
+
+    for (int i = 0; i < count; i++) {
+        brot_row_coords(brot, xPos + i * step, 1, step, &cx);
+
+        float x = 0;
+        float y = 0;
+        float xSaved = 0;
+        float ySaved = 0;
+        float temp;
+
+        int iteration = 0;
+        int saveAt = 1;
+
+        if (brot->interior_check && brot_in_main_regions(cx, yCoord)) {
+            iteration = brot->repeats;
+        }
+
+        while (x*x + y*y < 4 && iteration < brot->repeats) {
+            temp = x*x - y*y + cx;
+            y = 2*x*y + cy;
+            x = temp;
+
+            iteration++;
+
+            if (brot->periodicity_check) {
+                if (fabsf(x - xSaved) < epsilon && fabsf(y - ySaved) < epsilon) {
+                    iteration = brot->repeats;
+                    break;
+                }
+
+                if (iteration == saveAt) {
+                    xSaved = x;
+                    ySaved = y;
+                    saveAt *= 2;
+                }
+            }
+        }
+
+        raw[i] = iteration;
+        fraction[i] = brot_escape_fraction(brot, iteration, x, y);
+    }
+}
+
+// Works out where a pixel is from the double-double centre,
+// the offset from it is small enough for a double
+static Brot_DD brot_dd_coord(Brot_DD center, double span, int pos, int size)
+{
+    return brot_dd_add_double(center, span * ((double)pos / size - 0.5));
+}
+
+void brot_kernel_scalar_dd(Mandelbrot brot, int xPos, int yPos, int count, int step, uint16_t *fraction, int *raw)
+{
+    // y goes down the screen
+    Brot_DD cy = brot_dd_coord(brot->ddCenterY, -brot->spanY, yPos, brot->pixelHeight);
+    double epsilon = brot_period_epsilon(brot);
+
+    for (int i = 0; i < count; i++) {
+        Brot_DD cx = brot_dd_coord(brot->ddCenterX, brot->spanX, xPos + i * step, brot->pixelWidth);
+
+        Brot_DD x = {0, 0};
+        Brot_DD y = {0, 0};
+        Brot_DD xSaved = x;
+        Brot_DD ySaved = y;
+        Brot_DD xx = x;
+        Brot_DD yy = y;
+        Brot_DD xy;
+
+        int iteration = 0;
+        int saveAt = 1;
+
+        if (brot->interior_check && brot_in_main_regions(cx.hi, cy.hi)) {
+            iteration = brot->repeats;
+        }
+
+        while (xx.hi + yy.hi < 4 && iteration < brot->repeats) {
+            xy = brot_dd_mul(x, y);
+
+            x = brot_dd_add(brot_dd_sub(xx, yy), cx);
+            y = brot_dd_add((Brot_DD){2 * xy.hi, 2 * xy.lo}, cy);
+
+            xx = brot_dd_sqr(x);
+            yy = brot_dd_sqr(y);
+
+            iteration++;
+
+            if (brot->periodicity_check) {
+                if (fabs(brot_dd_sub(x, xSaved).hi) < epsilon && fabs(brot_dd_sub(y, ySaved).hi) < epsilon) {
+                    iteration = brot->repeats;
+                    break;
+                }
+
+                if (iteration == saveAt) {
+                    xSaved = x;
+                    ySaved = y;
+                    saveAt *= 2;
+                }
+            }
+        }
+
+        raw[i] = iteration;
+        fraction[i] = brot_escape_fraction(brot, iteration, x.hi, y.hi);
+    }
+}
+
+#ifdef BROT_X86
+
+// Vector version of brot_in_main_regions, returns a mask of the lanes
+// that are in the main cardioid or the period 2 bulb
+__attribute__((target("avx2")))
+static inline __m256d brot_main_regions_avx2(__m256d x, __m256d y)
+{
+    __m256d quarter = _mm256_set1_pd(0.25);
+    __m256d yy = _mm256_mul_pd(y, y);
+
+    __m256d xq = _mm256_sub_pd(x, quarter);
+    __m256d q  = _mm256_add_pd(_mm256_mul_pd(xq, xq), yy);
+
+    __m256d cardioid = _mm256_cmp_pd(_mm256_mul_pd(q, _mm256_add_pd(q, xq)),
+                                     _mm256_mul_pd(quarter, yy), _CMP_LE_OQ);
+
+    __m256d xb = _mm256_add_pd(x, _mm256_set1_pd(1.0));
+
+    __m256d bulb = _mm256_cmp_pd(_mm256_add_pd(_mm256_mul_pd(xb, xb), yy),
+                                 _mm256_set1_pd(0.0625), _CMP_LE_OQ);
+
+    return _mm256_or_pd(cardioid, bulb);
+}
+
+__attribute__((target("avx512f")))
+static inline __mmask8 brot_main_regions_avx512(__m512d x, __m512d y)
+{
+    __m512d quarter = _mm512_set1_pd(0.25);
+    __m512d yy = _mm512_mul_pd(y, y);
+
+    __m512d xq = _mm512_sub_pd(x, quarter);
+    __m512d q  = _mm512_add_pd(_mm512_mul_pd(xq, xq), yy);
+
+    __mmask8 cardioid = _mm512_cmp_pd_mask(_mm512_mul_pd(q, _mm512_add_pd(q, xq)),
+                                           _mm512_mul_pd(quarter, yy), _CMP_LE_OQ);
+
+    __m512d xb = _mm512_add_pd(x, _mm512_set1_pd(1.0));
+
+    __mmask8 bulb = _mm512_cmp_pd_mask(_mm512_add_pd(_mm512_mul_pd(xb, xb), yy),
+                                       _mm512_set1_pd(0.0625), _CMP_LE_OQ);
+
+    return cardioid | bulb;
+}
+
+// Four pixels at a time in the 256 bit registers
+__attribute__((target("avx2")))
+static void brot_kernel_avx2(Mandelbrot brot, int xPos, int yPos, int count, int step, uint16_t *fraction, int *raw)
+{
+    double yCoord = (double)brot->y1 - ((brot->y1 - brot->y2) * ((double)yPos / brot->pixelHeight));
+
+    __m256d x1     = _mm256_set1_pd(brot->x1);
+    __m256d plotX  = _mm256_set1_pd(brot->x2 - brot->x1);
+    __m256d width  = _mm256_set1_pd((double)brot->pixelWidth);
+    __m256d cy     = _mm256_set1_pd(yCoord);
+    __m256d four   = _mm256_set1_pd(4.0);
+    __m256d two    = _mm256_set1_pd(2.0);
+    __m256d one    = _mm256_set1_pd(1.0);
+    __m256d repeats = _mm256_set1_pd((double)brot->repeats);
+    __m256d epsilon = _mm256_set1_pd(brot_period_epsilon(brot));
+    __m256d absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+
+    double xs[4], ys[4], its[4];
+
+    for (int i = 0; i < count; i += 4) {
+
+        int lanes = (count - i < 4) ? count - i : 4;
+
+        // Lanes past the end of the span start off already finished
+        __m256d active = _mm256_castsi256_pd(_mm256_set_epi64x(
+                            lanes > 3 ? -1 : 0, lanes > 2 ? -1 : 0,
+                            lanes > 1 ? -1 : 0, -1));
+
+        __m256d pos = _mm256_set_pd(xPos + (i + 3) * step, xPos + (i + 2) * step,
+                                    xPos + (i + 1) * step, xPos + i * step);
+        __m256d cx  = _mm256_add_pd(x1, _mm256_mul_pd(plotX, _mm256_div_pd(pos, width)));
+
+        __m256d x = _mm256_setzero_pd();
+        __m256d y = _mm256_setzero_pd();
+        __m256d iteration = _mm256_setzero_pd();
+
+        if (brot->interior_check) {
+            // Lanes in the cardioid or bulb finish straight away, with
+            // the iteration count that marks them as inside the set
+            __m256d inside = brot_main_regions_avx2(cx, cy);
+            active = _mm256_andnot_pd(inside, active);
+            iteration = _mm256_blendv_pd(iteration, repeats, inside);
+        }
+
+        __m256d xSaved = _mm256_setzero_pd();
+        __m256d ySaved = _mm256_setzero_pd();
+        int saveAt = 1;
+
+        for (int n = 0; n < brot->repeats; n++) {
+
+            __m256d xx = _mm256_mul_pd(x, x);
+            __m256d yy = _mm256_mul_pd(y, y);
+
+            active = _mm256_and_pd(active, _mm256_cmp_pd(_mm256_add_pd(xx, yy), four, _CMP_LT_OQ));
+
+            if (_mm256_testz_pd(active, active)) {
+                break;
+            }
+
+            __m256d xNew = _mm256_add_pd(_mm256_sub_pd(xx, yy), cx);
+            __m256d yNew = _mm256_add_pd(_mm256_mul_pd(_mm256_mul_pd(two, x), y), cy);
+
+            // Only the lanes that haven't escaped move on
+            x = _mm256_blendv_pd(x, xNew, active);
+            y = _mm256_blendv_pd(y, yNew, active);
+
+            iteration = _mm256_add_pd(iteration, _mm256_and_pd(one, active));
+
+            if (brot->periodicity_check) {
+                // Lanes that have come back to their saved point are periodic
+                __m256d dx = _mm256_and_pd(_mm256_sub_pd(x, xSaved), absMask);
+                __m256d dy = _mm256_and_pd(_mm256_sub_pd(y, ySaved), absMask);
+                __m256d periodic = _mm256_and_pd(active,
+                                    _mm256_and_pd(_mm256_cmp_pd(dx, epsilon, _CMP_LT_OQ),
+                                                  _mm256_cmp_pd(dy, epsilon, _CMP_LT_OQ)));
+
+                active = _mm256_andnot_pd(periodic, active);
+                iteration = _mm256_blendv_pd(iteration, repeats, periodic);
+
+                if (n + 1 == saveAt) {
+                    xSaved = x;
+                    ySaved = y;
+                    saveAt *= 2;
+                }
+            }
+        }
+
+        _mm256_storeu_pd(xs, x);
+        _mm256_storeu_pd(ys, y);
+        _mm256_storeu_pd(its, iteration);
+
+        for (int lane = 0; lane < lanes; lane++) {
+            raw[i + lane] = (int)its[lane];
+            fraction[i + lane] = brot_escape_fraction(brot, raw[i + lane], xs[lane], ys[lane]);
+        }
+    }
+}
+
+// Eight pixels at a time in the 512 bit registers, with mask registers
+// keeping track of which lanes are still iterating
+__attribute__((target("avx512f")))
+static void brot_kernel_avx512(Mandelbrot brot, int xPos, int yPos, int count, int step, uint16_t *fraction, int *raw)
+{
+    double yCoord = (double)brot->y1 - ((brot->y1 - brot->y2) * ((double)yPos / brot->pixelHeight));
+
+    __m512d x1     = _mm512_set1_pd(brot->x1);
+    __m512d plotX  = _mm512_set1_pd(brot->x2 - brot->x1);
+    __m512d width  = _mm512_set1_pd((double)brot->pixelWidth);
+    __m512d cy     = _mm512_set1_pd(yCoord);
+    __m512d four   = _mm512_set1_pd(4.0);
+    __m512d two    = _mm512_set1_pd(2.0);
+    __m512d one    = _mm512_set1_pd(1.0);
+    __m512d offset = _mm512_mul_pd(_mm512_set_pd(7, 6, 5, 4, 3, 2, 1, 0), _mm512_set1_pd(step));
+    __m512d repeats = _mm512_set1_pd((double)brot->repeats);
+    __m512d epsilon = _mm512_set1_pd(brot_period_epsilon(brot));
+
+    double xs[8], ys[8], its[8];
+
+    for (int i = 0; i < count; i += 8) {
+
+        int lanes = (count - i < 8) ? count - i : 8;
+
+        __mmask8 active = (__mmask8)((1u << lanes) - 1);
+
+        __m512d pos = _mm512_add_pd(_mm512_set1_pd(xPos + i * step), offset);
+        __m512d cx  = _mm512_add_pd(x1, _mm512_mul_pd(plotX, _mm512_div_pd(pos, width)));
+
+        __m512d x = _mm512_setzero_pd();
+        __m512d y = _mm512_setzero_pd();
+        __m512d iteration = _mm512_setzero_pd();
+
+        if (brot->interior_check) {
+            __mmask8 inside = brot_main_regions_avx512(cx, cy) & active;
+            active &= ~inside;
+            iteration = _mm512_mask_mov_pd(iteration, inside, repeats);
+        }
+
+        __m512d xSaved = _mm512_setzero_pd();
+        __m512d ySaved = _mm512_setzero_pd();
+        int saveAt = 1;
+
+        for (int n = 0; n < brot->repeats; n++) {
+
+            __m512d xx = _mm512_mul_pd(x, x);
+            __m512d yy = _mm512_mul_pd(y, y);
+
+            active = _mm512_mask_cmp_pd_mask(active, _mm512_add_pd(xx, yy), four, _CMP_LT_OQ);
+
+            if (active == 0) {
+                break;
+            }
+
+            __m512d xNew = _mm512_add_pd(_mm512_sub_pd(xx, yy), cx);
+            __m512d yNew = _mm512_add_pd(_mm512_mul_pd(_mm512_mul_pd(two, x), y), cy);
+
+            x = _mm512_mask_mov_pd(x, active, xNew);
+            y = _mm512_mask_mov_pd(y, active, yNew);
+
+            iteration = _mm512_mask_add_pd(iteration, active, iteration, one);
+
+            if (brot->periodicity_check) {
+                __m512d dx = _mm512_abs_pd(_mm512_sub_pd(x, xSaved));
+                __m512d dy = _mm512_abs_pd(_mm512_sub_pd(y, ySaved));
+                __mmask8 periodic = _mm512_mask_cmp_pd_mask(active, dx, epsilon, _CMP_LT_OQ);
+                periodic = _mm512_mask_cmp_pd_mask(periodic, dy, epsilon, _CMP_LT_OQ);
+
+                active &= ~periodic;
+                iteration = _mm512_mask_mov_pd(iteration, periodic, repeats);
+
+                if (n + 1 == saveAt) {
+                    xSaved = x;
+                    ySaved = y;
+                    saveAt *= 2;
+                }
+            }
+        }
+
+        _mm512_storeu_pd(xs, x);
+        _mm512_storeu_pd(ys, y);
+        _mm512_storeu_pd(its, iteration);
+
+        for (int lane = 0; lane < lanes; lane++) {
+            raw[i + lane] = (int)its[lane];
+            fraction[i + lane] = brot_escape_fraction(brot, raw[i + lane], xs[lane], ys[lane]);
+        }
+    }
+}
+
+// Eight float pixels at a time in the 256 bit registers, the iteration
+// counts are kept as integers since floats run out of bits for them
+__attribute__((target("avx2")))
+static void brot_kernel_avx2_float(Mandelbrot brot, int xPos, int yPos, int count, int step, uint16_t *fraction, int *raw)
+{
+    double yCoord = brot_row_imaginary(brot, yPos);
+
+    __m256  cy      = _mm256_set1_ps((float)yCoord);
+    __m256  four    = _mm256_set1_ps(4.0f);
+    __m256  two     = _mm256_set1_ps(2.0f);
+    __m256i repeats = _mm256_set1_epi32(brot->repeats);
+    __m256  epsilon = _mm256_set1_ps((float)brot_period_epsilon(brot));
+    __m256  absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+    float cxs[8], xs[8], ys[8];
+    int its[8];
+
+    for (int i = 0; i < count; i += 8) {
+
+        int lanes = (count - i < 8) ? count - i : 8;
+
+        brot_row_coords(brot, xPos + i * step, 8, step, cxs);
+
+        __m256i laneIndex = _mm256_set_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+        __m256  active = _mm256_castsi256_ps(_mm256_cmpgt_epi32(_mm256_set1_epi32(lanes), laneIndex));
+
+        __m256  cx = _mm256_loadu_ps(cxs);
+        __m256  x = _mm256_setzero_ps();
+        __m256  y = _mm256_setzero_ps();
+        __m256i iteration = _mm256_setzero_si256();
+
+        if (brot->interior_check) {
+            int inside[8] = {0};
+            for (int lane = 0; lane < lanes; lane++) {
+                inside[lane] = -brot_in_main_regions(cxs[lane], yCoord);
+            }
+
+            __m256 insideMask = _mm256_castsi256_ps(_mm256_loadu_si256((__m256i*)inside));
+
+            active = _mm256_andnot_ps(insideMask, active);
+            iteration = _mm256_blendv_epi8(iteration, repeats, _mm256_castps_si256(insideMask));
+        }
+
+        __m256 xSaved = _mm256_setzero_ps();
+        __m256 ySaved = _mm256_setzero_ps();
+        int saveAt = 1;
+
+        for (int n = 0; n < brot->repeats; n++) {
+
+            __m256 xx = _mm256_mul_ps(x, x);
+            __m256 yy = _mm256_mul_ps(y, y);
+
+            active = _mm256_and_ps(active, _mm256_cmp_ps(_mm256_add_ps(xx, yy), four, _CMP_LT_OQ));
+
+            if (_mm256_testz_ps(active, active)) {
+                break;
+            }
+
+            __m256 xNew = _mm256_add_ps(_mm256_sub_ps(xx, yy), cx);
+            __m256 yNew = _mm256_add_ps(_mm256_mul_ps(_mm256_mul_ps(two, x), y), cy);
+
+            x = _mm256_blendv_ps(x, xNew, active);
+            y = _mm256_blendv_ps(y, yNew, active);
+
+            // Active lanes are all ones, which is -1
+            iteration = _mm256_sub_epi32(iteration, _mm256_castps_si256(active));
+
+            if (brot->periodicity_check) {
+                __m256 dx = _mm256_and_ps(_mm256_sub_ps(x, xSaved), absMask);
+                __m256 dy = _mm256_and_ps(_mm256_sub_ps(y, ySaved), absMask);
+                __m256 periodic = _mm256_and_ps(active,
+                                    _mm256_and_ps(_mm256_cmp_ps(dx, epsilon, _CMP_LT_OQ),
+                                                  _mm256_cmp_ps(dy, epsilon, _CMP_LT_OQ)));
+
+                active = _mm256_andnot_ps(periodic, active);
+                iteration = _mm256_blendv_epi8(iteration, repeats, _mm256_castps_si256(periodic));
+
+                if (n + 1 == saveAt) {
+                    xSaved = x;
+                    ySaved = y;
+                    saveAt *= 2;
+                }
+            }
+        }
+
+        _mm256_storeu_ps(xs, x);
+        _mm256_storeu_ps(ys, y);
+        _mm256_storeu_si256((__m256i*)its, iteration);
+
+        for (int lane = 0; lane < lanes; lane++) {
+            raw[i + lane] = its[lane];
+            fraction[i + lane] = brot_escape_fraction(brot, raw[i + lane], xs[lane], ys[lane]);
+        }
+    }
+}
+
+// Sixteen float pixels at a time in the 512 bit registers
+__attribute__((target("avx512f")))
+static void brot_kernel_avx512_float(Mandelbrot brot, int xPos, int yPos, int count, int step, uint16_t *fraction, int *raw)
+{
+    double yCoord = brot_row_imaginary(brot, yPos);
+
+    __m512  cy      = _mm512_set1_ps((float)yCoord);
+    __m512  four    = _mm512_set1_ps(4.0f);
+    __m512  two     = _mm512_set1_ps(2.0f);
+    __m512i one     = _mm512_set1_epi32(1);
+    __m512i repeats = _mm512_set1_epi32(brot->repeats);
+    __m512  epsilon = _mm512_set1_ps((float)brot_period_epsilon(brot));
+
+    float cxs[16], xs[16], ys[16];
+    int its[16];
+
+    for (int i = 0; i < count; i += 16) {
+
+        int lanes = (count - i < 16) ? count - i : 16;
+
+        __mmask16 active = (__mmask16)((1u << lanes) - 1);
+
+        brot_row_coords(brot, xPos + i * step, 16, step, cxs);
+
+        __m512  cx = _mm512_loadu_ps(cxs);
+        __m512  x = _mm512_setzero_ps();
+        __m512  y = _mm512_setzero_ps();
+        __m512i iteration = _mm512_setzero_si512();
+
+        if (brot->interior_check) {
+            __mmask16 inside = 0;
+            for (int lane = 0; lane < lanes; lane++) {
+                inside |= brot_in_main_regions(cxs[lane], yCoord) << lane;
+            }
+            active &= ~inside;
+            iteration = _mm512_mask_mov_epi32(iteration, inside, repeats);
+        }
+
+        __m512 xSaved = _mm512_setzero_ps();
+        __m512 ySaved = _mm512_setzero_ps();
+        int saveAt = 1;
+
+        for (int n = 0; n < brot->repeats; n++) {
+
+            __m512 xx = _mm512_mul_ps(x, x);
+            __m512 yy = _mm512_mul_ps(y, y);
+
+            active = _mm512_mask_cmp_ps_mask(active, _mm512_add_ps(xx, yy), four, _CMP_LT_OQ);
+
+            if (active == 0) {
+                break;
+            }
+
+            __m512 xNew = _mm512_add_ps(_mm512_sub_ps(xx, yy), cx);
+            __m512 yNew = _mm512_add_ps(_mm512_mul_ps(_mm512_mul_ps(two, x), y), cy);
+
+            x = _mm512_mask_mov_ps(x, active, xNew);
+            y = _mm512_mask_mov_ps(y, active, yNew);
+
+            iteration = _mm512_mask_add_epi32(iteration, active, iteration, one);
+
+            if (brot->periodicity_check) {
+                __m512 dx = _mm512_abs_ps(_mm512_sub_ps(x, xSaved));
+                __m512 dy = _mm512_abs_ps(_mm512_sub_ps(y, ySaved));
+                __mmask16 periodic = _mm512_mask_cmp_ps_mask(active, dx, epsilon, _CMP_LT_OQ);
+                periodic = _mm512_mask_cmp_ps_mask(periodic, dy, epsilon, _CMP_LT_OQ);
+
+                active &= ~periodic;
+                iteration = _mm512_mask_mov_epi32(iteration, periodic, repeats);
+
+                if (n + 1 == saveAt) {
+                    xSaved = x;
+                    ySaved = y;
+                    saveAt *= 2;
+                }
+            }
+        }
+
+        _mm512_storeu_ps(xs, x);
+        _mm512_storeu_ps(ys, y);
+        _mm512_storeu_si512(its, iteration);
+
+        for (int lane = 0; lane < lanes; lane++) {
+            raw[i + lane] = its[lane];
+            fraction[i + lane] = brot_escape_fraction(brot, raw[i + lane], xs[lane], ys[lane]);
+        }
+    }
+}
+
+// The double-double operations again, four lanes at a time.
+// Fused multiply-adds give the rounding error of a product in one go
+// and it is the same exact error Dekker's method gets in brot_dd_two_prod
+typedef struct brot_dd_avx2 {
+    __m256d hi;
+    __m256d lo;
+} Brot_DD_AVX2;
+
+__attribute__((target("avx2,fma")))
+static inline Brot_DD_AVX2 brot_dd_quick_two_sum_avx2(__m256d a, __m256d b)
+{
+    Brot_DD_AVX2 r;
+
+    r.hi = _mm256_add_pd(a, b);
+    r.lo = _mm256_sub_pd(b, _mm256_sub_pd(r.hi, a));
+
+    return r;
+}
+
+__attribute__((target("avx2,fma")))
+static inline Brot_DD_AVX2 brot_dd_two_sum_avx2(__m256d a, __m256d b)
+{
+    Brot_DD_AVX2 r;
+
+    r.hi = _mm256_add_pd(a, b);
+    __m256d bb = _mm256_sub_pd(r.hi, a);
+    r.lo = _mm256_add_pd(_mm256_sub_pd(a, _mm256_sub_pd(r.hi, bb)), _mm256_sub_pd(b, bb));
+
+    return r;
+}
+
+__attribute__((target("avx2,fma")))
+static inline Brot_DD_AVX2 brot_dd_add_avx2(Brot_DD_AVX2 a, Brot_DD_AVX2 b)
+{
+    Brot_DD_AVX2 s = brot_dd_two_sum_avx2(a.hi, b.hi);
+    Brot_DD_AVX2 t = brot_dd_two_sum_avx2(a.lo, b.lo);
+
+    s.lo = _mm256_add_pd(s.lo, t.hi);
+    s = brot_dd_quick_two_sum_avx2(s.hi, s.lo);
+    s.lo = _mm256_add_pd(s.lo, t.lo);
+
+    return brot_dd_quick_two_sum_avx2(s.hi, s.lo);
+}
+
+__attribute__((target("avx2,fma")))
+static inline Brot_DD_AVX2 brot_dd_sub_avx2(Brot_DD_AVX2 a, Brot_DD_AVX2 b)
+{
+    __m256d sign = _mm256_set1_pd(-0.0);
+
+    b.hi = _mm256_xor_pd(b.hi, sign);
+    b.lo = _mm256_xor_pd(b.lo, sign);
+
+    return brot_dd_add_avx2(a, b);
+}
+
+__attribute__((target("avx2,fma")))
+static inline Brot_DD_AVX2 brot_dd_mul_avx2(Brot_DD_AVX2 a, Brot_DD_AVX2 b)
+{
+    __m256d hi = _mm256_mul_pd(a.hi, b.hi);
+    __m256d lo = _mm256_fmsub_pd(a.hi, b.hi, hi);
+
+    lo = _mm256_add_pd(lo, _mm256_add_pd(_mm256_mul_pd(a.hi, b.lo), _mm256_mul_pd(a.lo, b.hi)));
+
+    return brot_dd_quick_two_sum_avx2(hi, lo);
+}
+
+__attribute__((target("avx2,fma")))
+static inline Brot_DD_AVX2 brot_dd_sqr_avx2(Brot_DD_AVX2 a)
+{
+    __m256d hi = _mm256_mul_pd(a.hi, a.hi);
+    __m256d lo = _mm256_fmsub_pd(a.hi, a.hi, hi);
+
+    lo = _mm256_add_pd(lo, _mm256_mul_pd(_mm256_mul_pd(_mm256_set1_pd(2.0), a.hi), a.lo));
+
+    return brot_dd_quick_two_sum_avx2(hi, lo);
+}
+
+__attribute__((target("avx2,fma")))
+static inline Brot_DD_AVX2 brot_dd_blend_avx2(Brot_DD_AVX2 a, Brot_DD_AVX2 b, __m256d mask)
+{
+    a.hi = _mm256_blendv_pd(a.hi, b.hi, mask);
+    a.lo = _mm256_blendv_pd(a.lo, b.lo, mask);
+
+    return a;
+}
+
+// Four double-double pixels at a time, the same steps as brot_kernel_scalar_dd
+__attribute__((target("avx2,fma")))
+static void brot_kernel_avx2_dd(Mandelbrot brot, int xPos, int yPos, int count, int step, uint16_t *fraction, int *raw)
+{
+    Brot_DD cyScalar = brot_dd_coord(brot->ddCenterY, -brot->spanY, yPos, brot->pixelHeight);
+
+    Brot_DD_AVX2 cy = {_mm256_set1_pd(cyScalar.hi), _mm256_set1_pd(cyScalar.lo)};
+
+    __m256d four    = _mm256_set1_pd(4.0);
+    __m256d two     = _mm256_set1_pd(2.0);
+    __m256d one     = _mm256_set1_pd(1.0);
+    __m256d repeats = _mm256_set1_pd((double)brot->repeats);
+    __m256d epsilon = _mm256_set1_pd(brot_period_epsilon(brot));
+    __m256d absMask = _mm256_castsi256_pd(_mm256_set1_epi64x(0x7fffffffffffffffLL));
+
+    double cxHi[4], cxLo[4], xs[4], ys[4], its[4];
+    long long inside[4];
+
+    for (int i = 0; i < count; i += 4) {
+
+        int lanes = (count - i < 4) ? count - i : 4;
+
+        for (int lane = 0; lane < 4; lane++) {
+            Brot_DD cx = brot_dd_coord(brot->ddCenterX, brot->spanX, xPos + (i + lane) * step, brot->pixelWidth);
+            cxHi[lane] = cx.hi;
+            cxLo[lane] = cx.lo;
+            inside[lane] = brot->interior_check && lane < lanes &&
+                           brot_in_main_regions(cx.hi, cyScalar.hi) ? -1 : 0;
+        }
+
+        __m256d active = _mm256_castsi256_pd(_mm256_set_epi64x(
+                            lanes > 3 ? -1 : 0, lanes > 2 ? -1 : 0,
+                            lanes > 1 ? -1 : 0, -1));
+
+        __m256d insideMask = _mm256_castsi256_pd(_mm256_loadu_si256((__m256i*)inside));
+
+        active = _mm256_andnot_pd(insideMask, active);
+
+        Brot_DD_AVX2 cx = {_mm256_loadu_pd(cxHi), _mm256_loadu_pd(cxLo)};
+        Brot_DD_AVX2 zero = {_mm256_setzero_pd(), _mm256_setzero_pd()};
+
+        Brot_DD_AVX2 x = zero, y = zero, xx = zero, yy = zero;
+        Brot_DD_AVX2 xSaved = zero, ySaved = zero;
+        Brot_DD_AVX2 xy, xNew, yNew;
+
+        __m256d iteration = _mm256_and_pd(repeats, insideMask);
+        int saveAt = 1;
+
+        for (int n = 0; n < brot->repeats; n++) {
+
+            active = _mm256_and_pd(active, _mm256_cmp_pd(_mm256_add_pd(xx.hi, yy.hi), four, _CMP_LT_OQ));
+
+            if (_mm256_testz_pd(active, active)) {
+                break;
+            }
+
+            xy = brot_dd_mul_avx2(x, y);
+            xy.hi = _mm256_mul_pd(two, xy.hi);
+            xy.lo = _mm256_mul_pd(two, xy.lo);
+
+            xNew = brot_dd_add_avx2(brot_dd_sub_avx2(xx, yy), cx);
+            yNew = brot_dd_add_avx2(xy, cy);
+
+            x = brot_dd_blend_avx2(x, xNew, active);
+            y = brot_dd_blend_avx2(y, yNew, active);
+
+            xx = brot_dd_sqr_avx2(x);
+            yy = brot_dd_sqr_avx2(y);
+
+            iteration = _mm256_add_pd(iteration, _mm256_and_pd(one, active));
+
+            if (brot->periodicity_check) {
+                __m256d dx = _mm256_and_pd(brot_dd_sub_avx2(x, xSaved).hi, absMask);
+                __m256d dy = _mm256_and_pd(brot_dd_sub_avx2(y, ySaved).hi, absMask);
+                __m256d periodic = _mm256_and_pd(active,
+                                    _mm256_and_pd(_mm256_cmp_pd(dx, epsilon, _CMP_LT_OQ),
+                                                  _mm256_cmp_pd(dy, epsilon, _CMP_LT_OQ)));
+
+                active = _mm256_andnot_pd(periodic, active);
+                iteration = _mm256_blendv_pd(iteration, repeats, periodic);
+
+                if (n + 1 == saveAt) {
+                    xSaved = x;
+                    ySaved = y;
+                    saveAt *= 2;
+                }
+            }
+        }
+
+        _mm256_storeu_pd(xs, x.hi);
+        _mm256_storeu_pd(ys, y.hi);
+        _mm256_storeu_pd(its, iteration);
+
+        for (int lane = 0; lane < lanes; lane++) {
+            raw[i + lane] = (int)its[lane];
+            fraction[i + lane] = brot_escape_fraction(brot, raw[i + lane], xs[lane], ys[lane]);
+        }
+    }
+}
+
+#endif
+
+Brot_Kernel brot_kernel_select(Brot_ISA *isa)
+{
+#ifdef BROT_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("avx512f")) {
+        *isa = BROT_ISA_AVX512;
+        return brot_kernel_avx512;
+    }
+
+    if (__builtin_cpu_supports("avx2")) {
+        *isa = BROT_ISA_AVX2;
+        return brot_kernel_avx2;
+    }
+#endif
+
+    *isa = BROT_ISA_SCALAR;
+    return brot_kernel_scalar;
+}
+
+Brot_Kernel brot_kernel_float(Brot_ISA isa)
+{
+    switch (isa) {
+#ifdef BROT_X86
+        case BROT_ISA_AVX512:
+            return brot_kernel_avx512_float;
+        case BROT_ISA_AVX2:
+            return brot_kernel_avx2_float;
+#endif
+        case BROT_ISA_SCALAR:
+        default:
+            return brot_kernel_scalar_float;
+    }
+}
+
+Brot_Kernel brot_kernel_dd(Brot_ISA isa)
+{
+#ifdef BROT_X86
+    // There's no 512 bit version, the AVX2 one does fine on those CPUs
+    if (isa != BROT_ISA_SCALAR && __builtin_cpu_supports("fma")) {
+        return brot_kernel_avx2_dd;
+    }
+#endif
+
+    return brot_kernel_scalar_dd;
+}
+
+const char *brot_isa_name(Brot_ISA isa)
+{
+    switch (isa) {
+        case BROT_ISA_AVX512:
+            return "avx512";
+        case BROT_ISA_AVX2:
+            return "avx2";
+        case BROT_ISA_SCALAR:
+        default:
+            return "scalar";
+    }
+}
@@ -5561,6 +5561,244 @@ unsigned lodepng_encode24_file(const char* filename, const unsigned char* image,
 {
   return lodepng_encode_file(filename, image, w, h, LCT_RGB, 8);
 }
+
+#ifdef LODEPNG_COMPILE_ZLIB
+
+/*Filtered bytes gathered before they are deflated as one block, same minimum as lodepng_deflatev uses*/
+#define STREAM_BLOCK_SIZE 65535
+
+struct LodePNGStream
+{
+  FILE* file;
+  unsigned w, h;
+  unsigned y; /*scanlines pushed so far*/
+  size_t linebytes;
+
+  unsigned char* prevline; /*the previous unfiltered scanline, for the filters that look up*/
+  unsigned char* attempt[5]; /*the scanline with each of the five filters, to pick the best*/
+
+  /*
+  Filtered scanlines waiting to be deflated, after enough of the ones before them
+  to fill the LZ77 window. The window part is only ever dropped in whole multiples
+  of the window size, so the positions in the circular hash stay the same.
+  */
+  unsigned char* in;
+  size_t inpos; /*where the data that isn't deflated yet starts*/
+  size_t insize;
+
+  LodePNGCompressSettings settings;
+  Hash hash;
+  ucvector out; /*deflated bytes not yet written, the last one may be partly filled*/
+  size_t bp;
+  unsigned adler;
+
+  unsigned error;
+};
+
+static unsigned stream_write_chunk(LodePNGStream* stream, const char* type,
+                                   const unsigned char* data, size_t length)
+{
+  unsigned char header[8];
+  unsigned char footer[4];
+  unsigned crc, i;
+
+  lodepng_set32bitInt(header, (unsigned)length);
+  for(i = 0; i < 4; i++) header[4 + i] = (unsigned char)type[i];
+
+  crc = Crc32_update_crc((const unsigned char*)type, 0xffffffffL, 4);
+  crc = Crc32_update_crc(data, crc, length) ^ 0xffffffffL;
+  lodepng_set32bitInt(footer, crc);
+
+  if(fwrite(header, 1, 8, stream->file) != 8) return 87;
+  if(length && fwrite(data, 1, length, stream->file) != length) return 87;
+  if(fwrite(footer, 1, 4, stream->file) != 4) return 87;
+  return 0;
+}
+
+/*Deflates everything waiting as one block and writes out all the whole bytes of it*/
+static unsigned stream_deflate(LodePNGStream* stream, int final)
+{
+  size_t bytes, drop, i;
+  unsigned error;
+
+  error = deflateDynamic(&stream->out, &stream->bp, &stream->hash, stream->in,
+                         stream->inpos, stream->insize, &stream->settings, final);
+  if(error) return error;
+
+  stream->inpos = stream->insize;
+
+  /*keep at least a window of history, dropping the rest in whole windows*/
+  if(stream->insize > stream->settings.windowsize)
+  {
+    drop = (stream->insize - stream->settings.windowsize) / stream->settings.windowsize * stream->settings.windowsize;
+    for(i = drop; i < stream->insize; i++) stream->in[i - drop] = stream->in[i];
+    stream->insize -= drop;
+    stream->inpos = stream->insize;
+  }
+
+  if(final)
+  {
+    /*the last byte is padded out, then the zlib checksum goes after*/
+    stream->bp = (stream->bp + 7) / 8 * 8;
+    lodepng_add32bitInt(&stream->out, stream->adler);
+    stream->bp += 32;
+  }
+
+  bytes = stream->bp / 8;
+  if(bytes == 0) return 0;
+
+  error = stream_write_chunk(stream, "IDAT", stream->out.data, bytes);
+  if(error) return error;
+
+  /*carry the partly filled byte over to the next block*/
+  if(stream->bp % 8) stream->out.data[0] = stream->out.data[bytes];
+  stream->out.size = stream->bp % 8 ? 1 : 0;
+  stream->bp %= 8;
+
+  return 0;
+}
+
+unsigned lodepng_stream_open(LodePNGStream** stream, const char* filename, unsigned w, unsigned h)
+{
+  static const unsigned char signature[8] = {137, 80, 78, 71, 13, 10, 26, 10};
+  unsigned char header[13];
+  unsigned CMFFLG = 256 * 120; /*same zlib header as lodepng_zlib_compress*/
+  unsigned type;
+  LodePNGStream* s;
+
+  *stream = 0;
+  if(w == 0 || h == 0) return 89;
+
+  s = (LodePNGStream*)mymalloc(sizeof(LodePNGStream));
+  if(!s) return 83;
+
+  s->file = 0;
+  s->w = w;
+  s->h = h;
+  s->y = 0;
+  s->linebytes = (size_t)w * 3;
+  s->inpos = 0;
+  s->insize = 0;
+  s->bp = 0;
+  s->adler = 1;
+
+  lodepng_compress_settings_init(&s->settings);
+  ucvector_init(&s->out);
+
+  s->prevline = (unsigned char*)mymalloc(s->linebytes);
+  for(type = 0; type < 5; type++) s->attempt[type] = (unsigned char*)mymalloc(s->linebytes);
+  /*room for the window kept, up to one window more that couldn't be dropped, and a block*/
+  s->in = (unsigned char*)mymalloc(2 * s->settings.windowsize + STREAM_BLOCK_SIZE + s->linebytes + 1);
+
+  s->error = hash_init(&s->hash, s->settings.windowsize);
+  if(!s->error && (!s->prevline || !s->in)) s->error = 83;
+  for(type = 0; type < 5; type++) if(!s->attempt[type]) s->error = 83;
+
+  if(!s->error)
+  {
+    s->file = fopen(filename, "wb");
+    if(!s->file) s->error = 79;
+  }
+
+  if(!s->error)
+  {
+    lodepng_set32bitInt(header, w);
+    lodepng_set32bitInt(header + 4, h);
+    header[8] = 8; /*bit depth*/
+    header[9] = LCT_RGB;
+    header[10] = 0; /*compression method*/
+    header[11] = 0; /*filter method*/
+    header[12] = 0; /*interlace method*/
+
+    if(fwrite(signature, 1, 8, s->file) != 8) s->error = 87;
+    if(!s->error) s->error = stream_write_chunk(s, "IHDR", header, 13);
+
+    CMFFLG += 31 - CMFFLG % 31;
+    ucvector_push_back(&s->out, (unsigned char)(CMFFLG / 256));
+    ucvector_push_back(&s->out, (unsigned char)(CMFFLG % 256));
+    s->bp = 16;
+  }
+
+  if(s->error)
+  {
+    unsigned error = s->error;
+    lodepng_stream_close(s);
+    return error;
+  }
+
+  *stream = s;
+  return 0;
+}
+
+unsigned lodepng_stream_push(LodePNGStream* stream, const unsigned char* scanline)
+{
+  const unsigned char* prevline = stream->y > 0 ? stream->prevline : 0;
+  size_t sum, smallest = 0;
+  unsigned type, bestType = 0;
+  size_t x;
+
+  if(stream->error) return stream->error;
+  if(stream->y >= stream->h) return stream->error = 88;
+
+  /*same minimum sum heuristic filter() uses for RGB*/
+  for(type = 0; type < 5; type++)
+  {
+    filterScanline(stream->attempt[type], scanline, prevline, stream->linebytes, 3, type);
+
+    sum = 0;
+    for(x = 0; x < stream->linebytes; x += 3)
+    {
+      if(type == 0) sum += stream->attempt[type][x];
+      else
+      {
+        signed char c = (signed char)(stream->attempt[type][x]);
+        sum += c < 0 ? -c : c;
+      }
+    }
+
+    if(type == 0 || sum < smallest)
+    {
+      bestType = type;
+      smallest = sum;
+    }
+  }
+
+  for(x = 0; x < stream->linebytes; x++) stream->prevline[x] = scanline[x];
+  stream->y++;
+
+  stream->in[stream->insize] = (unsigned char)bestType;
+  for(x = 0; x < stream->linebytes; x++) stream->in[stream->insize + 1 + x] = stream->attempt[bestType][x];
+  stream->adler = update_adler32(stream->adler, stream->in + stream->insize, (unsigned)stream->linebytes + 1);
+  stream->insize += stream->linebytes + 1;
+
+  /*the last block is always left for the last scanline, so it's never empty*/
+  if(stream->y == stream->h) stream->error = stream_deflate(stream, 1);
+  else if(stream->insize - stream->inpos >= STREAM_BLOCK_SIZE) stream->error = stream_deflate(stream, 0);
+
+  return stream->error;
+}
+
+unsigned lodepng_stream_close(LodePNGStream* stream)
+{
+  unsigned error = stream->error;
+  unsigned type;
+
+  if(!error && stream->y != stream->h) error = 88;
+  if(!error) error = stream_write_chunk(stream, "IEND", 0, 0);
+
+  if(stream->file && fclose(stream->file) != 0 && !error) error = 87;
+
+  hash_cleanup(&stream->hash);
+  ucvector_cleanup(&stream->out);
+  myfree(stream->prevline);
+  for(type = 0; type < 5; type++) myfree(stream->attempt[type]);
+  myfree(stream->in);
+  myfree(stream);
+
+  return error;
+}
+
+#endif /*LODEPNG_COMPILE_ZLIB*/
 #endif /*LODEPNG_COMPILE_DISK*/
 
 void lodepng_encoder_settings_init(LodePNGEncoderSettings* settings)
@@ -5682,6 +5920,9 @@ const char* lodepng_error_text(unsigned code)
     case 84: return "given image too small to contain all pixels to be encoded";
     case 85: return "internal color conversion bug";
     case 86: return "impossible offset in lz77 encoding (internal bug)";
+    case 87: return "failed to write to the file";
+    case 88: return "streaming encoder was given the wrong number of scanlines";
+    case 89: return "streaming encoder needs an image at least one pixel wide and high";
   }
   return "unknown error code";
 }
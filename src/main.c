@@ -1,78 +1,114 @@
 #include <stdio.h>
 #include <stdlib.h>
-#include <unistd.h>
+#include <math.h>
+#include <string.h>
+#include <pthread.h>
 #include <SDL/SDL.h>
 
 #include "main.h"
 #include "mandelbrot.h"
-#include "lodepng.h"
+#include "image.h"
+#include "palette.h"
 
 #define BPP    4
 #define DEPTH  32
 
+// How many pixels the arrow keys move the view by
+#define PAN_STEP 64
 
-void usage(int exitval) {
-    printf("Mandelbrot usage:\n");
-    printf("mandelbrot width height outputfile\n");
-    exit(exitval);
-}
+// How many palette entries the colours move along each time the
+// screen is redrawn while the palette is cycling
+#define CYCLE_STEP 16
 
-Args parse_args(int argc, char *argv[]) {
+// How many pixels a mouse selection can be off a whole number
+// zoom ratio by and still be snapped to it
+#define ZOOM_SNAP 2
 
-    Args args = {0, 0, ""};
+// How the canvas colours, which are always 0x00RRGGBB, get turned into
+// pixels of the screen. Worked out once when the screen is set up
+typedef struct screen_format {
+    // Set when the screen's pixels are laid out the same as the canvas,
+    // so rows can be copied straight over
+    int direct;
 
-    int c;
-    while ( (c = getopt(argc, argv, "")) != -1) {
-        switch (c)
-        {
-            default:
-                usage(0);
-                break;
-        }
-    }
+    // For anything else, how far each of red, green and blue is moved
+    // down out of the canvas colour and then up into place in the pixel
+    int down[3];
+    int up[3];
+} Screen_Format;
+
+Screen_Format screen_format(SDL_Surface *screen)
+{
+    SDL_PixelFormat *format = screen->format;
+    Screen_Format result;
 
+    result.direct = format->BytesPerPixel == BPP &&
+                    format->Rmask == 0x00FF0000 && format->Gmask == 0x0000FF00 && format->Bmask == 0x000000FF;
 
-    args.output_file =  argv[1];
+    // Dropping the low bits of a channel too, for screens with fewer than 8 bits of it
+    result.down[0] = 16 + format->Rloss;
+    result.down[1] = 8 + format->Gloss;
+    result.down[2] = format->Bloss;
 
-    if (*args.output_file == '\0') {
-        printf("Need to specify an output file\n");
-        usage(1);
-    } else {
-        printf("Writing images to %s\n", args.output_file);
-    }
+    result.up[0] = format->Rshift;
+    result.up[1] = format->Gshift;
+    result.up[2] = format->Bshift;
 
-    return args;
+    return result;
 }
 
-void setpixel(SDL_Surface *screen, int x, int y, Uint32 colour)
+// Converts a row of canvas colours for a 32 bit screen laid out some other way
+void screen_convert_row(const Screen_Format *format, const uint32_t *row, Uint32 *pixels, int width)
 {
-    Uint32 *pixmem32;
-    Uint32 pColour;
+    uint32_t colour;
 
-    pColour = SDL_MapRGB(screen->format,
-                         (colour >> 16) & 255,
-                         (colour >> 8)  & 255,
-                         (colour )      & 255
-                         );
+    int redMask = 255 >> (format->down[0] - 16);
+    int greenMask = 255 >> (format->down[1] - 8);
+    int blueMask = 255 >> format->down[2];
 
-    pixmem32 = (Uint32*) screen->pixels + y + x;
-    *pixmem32 = pColour;
+    for (int x = 0; x < width; x++) {
+        colour = row[x];
+        pixels[x] = ((colour >> format->down[0]) & redMask) << format->up[0] |
+                    ((colour >> format->down[1]) & greenMask) << format->up[1] |
+                    ((colour >> format->down[2]) & blueMask) << format->up[2];
+    }
 }
 
-void draw_screen(Mandelbrot brot, SDL_Surface* screen)
+// Prints the precision the frame was calculated in whenever it changes,
+// so it can be seen where the zoom switches between them
+void report_precision(Mandelbrot brot)
 {
+    static int reported = -1;
+
+    if ((int)brot->precision != reported) {
+        printf("Calculating in %s precision at a pixel spacing of %g\n",
+               brot_precision_name(brot->precision), brot_pixel_spacing(brot));
+        reported = brot->precision;
+    }
+}
+
+void draw_screen(Mandelbrot brot, SDL_Surface* screen, const Screen_Format *format)
+{
+    report_precision(brot);
+
     if(SDL_MUSTLOCK(screen)) {
         if(SDL_LockSurface(screen) < 0) {
             return;
         }
     }
 
-    int yPos;
+    uint32_t *row;
+    Uint32 *pixels;
 
+    // The canvas is the size of the screen, its rows are just spaced differently
     for (int y = 0; y < screen->h; y++) {
-        yPos = (y * screen->pitch) / BPP;
-        for (int x = 0; x < screen->w; x++) {
-            setpixel(screen, x, yPos, brot->canvas[x][y]);
+        row = brot->canvas + y * brot->stride;
+        pixels = (Uint32*) ((Uint8*) screen->pixels + y * screen->pitch);
+
+        if (format->direct) {
+            memcpy(pixels, row, screen->w * BPP);
+        } else {
+            screen_convert_row(format, row, pixels, screen->w);
         }
     }
 
@@ -83,46 +119,256 @@ void draw_screen(Mandelbrot brot, SDL_Surface* screen)
     SDL_Flip(screen);
 }
 
-void render_png(Mandelbrot brot, char* output_file)
+// Things the render thread can be asked to do, in the order they were asked
+typedef enum viewer_action {
+    VIEWER_CALCULATE,
+    VIEWER_ZOOM,
+    VIEWER_ZOOM_OUT,
+    VIEWER_RESET,
+    VIEWER_PAN,
+    VIEWER_PNG,
+
+    // These only colour the frame again, they don't move the view
+    VIEWER_PALETTE,
+    VIEWER_COLOURING
+} Viewer_Action;
+
+typedef struct viewer_command {
+    Viewer_Action action;
+
+    // The corners for a zoom, or the pixels to move by for a pan
+    double x1, y1, x2, y2;
+    int xPixels, yPixels;
+} Viewer_Command;
+
+// How many commands can be waiting for the render thread
+// Anything past this is dropped rather than making the UI wait
+#define VIEWER_QUEUE 16
+
+// Shared between the UI thread, which handles the SDL events and draws
+// the screen, and the render thread, which owns the brot and calculates
+typedef struct viewer {
+    Mandelbrot brot;
+    SDL_Surface *screen;
+    char *output_file;
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t changed;
+
+    Viewer_Command queue[VIEWER_QUEUE];
+    int first;
+    int count;
+
+    // How many of the queued commands move the view, while there are
+    // any the frame being calculated is out of date
+    int moves;
+
+    // Set by the UI thread once it has drawn the canvas it was sent
+    int presented;
+
+    // While set the render thread cycles the palette whenever it has
+    // nothing else to do, as fast as the screen can be redrawn
+    int cycling;
+
+    int running;
+} Viewer;
+
+// Tells the UI thread there's a finished pass or frame in the canvas and
+// waits until it's on the screen, so the canvas isn't written over mid draw
+void viewer_present(Viewer *viewer)
 {
-    int width  = brot->pixelWidth;
-    int height = brot->pixelHeight;
+    SDL_Event event;
+
+    event.type = SDL_USEREVENT;
+    event.user.code = 0;
+    event.user.data1 = NULL;
+    event.user.data2 = NULL;
 
-    Uint32 colour;
+    pthread_mutex_lock(&viewer->lock);
 
-    unsigned err;
+    viewer->presented = 0;
 
-    unsigned char* image = malloc(width * height * 4);
+    // Nothing will come back if the event queue is full
+    if (SDL_PushEvent(&event) < 0) {
+        viewer->presented = 1;
+    }
+
+    while (!viewer->presented && viewer->running) {
+        pthread_cond_wait(&viewer->changed, &viewer->lock);
+    }
 
-    for (int y = 0; y < height; y++) {
-        for (int x = 0; x < width; x++) {
-            colour = brot->canvas[x][y];
-            image[4 * width * y + 4 * x + 0] = (colour >> 16) & 255;
-            image[4 * width * y + 4 * x + 1] = (colour >> 8)  & 255;
-            image[4 * width * y + 4 * x + 2] = (colour)       & 255;
-            image[4 * width * y + 4 * x + 3] = 255;
+    pthread_mutex_unlock(&viewer->lock);
+}
+
+// Shows the rough passes of a frame while the rest of it is calculated
+void draw_progress(Mandelbrot brot, void *data)
+{
+    (void)brot;
+
+    viewer_present((Viewer*) data);
+}
+
+// Whether the command changes the view, rather than doing something with the frame
+int viewer_moves(Viewer_Action action)
+{
+    return action != VIEWER_PNG && action != VIEWER_PALETTE && action != VIEWER_COLOURING;
+}
+
+// Switches to the built in palette after the current one
+void viewer_next_palette(Mandelbrot brot)
+{
+    const char *name;
+    int next = 0;
+
+    for (int i = 0; (name = brot_palette_name(i)) != NULL; i++) {
+        if (strcmp(name, brot->palette->name) == 0 && brot_palette_name(i + 1) != NULL) {
+            next = i + 1;
         }
     }
 
-    err = lodepng_encode32_file(output_file, image, width, height);
+    brot_set_palette(brot, brot_palette_name(next));
+}
+
+// Called from the UI thread. A command that moves the view cancels
+// whatever frame is being calculated, since it's about to be replaced
+void viewer_send(Viewer *viewer, Viewer_Command command)
+{
+    pthread_mutex_lock(&viewer->lock);
+
+    if (viewer->count == VIEWER_QUEUE) {
+        pthread_mutex_unlock(&viewer->lock);
+        return;
+    }
+
+    viewer->queue[(viewer->first + viewer->count) % VIEWER_QUEUE] = command;
+    viewer->count++;
+
+    if (viewer_moves(command.action)) {
+        viewer->moves++;
+        atomic_store(&viewer->brot->cancel, 1);
+    }
+
+    pthread_cond_broadcast(&viewer->changed);
+    pthread_mutex_unlock(&viewer->lock);
+}
+
+void *viewer_render(void *arg)
+{
+    Viewer *viewer = (Viewer*) arg;
+    Mandelbrot brot = viewer->brot;
+    Mandelbrot done;
+    Viewer_Command command;
+
+    while (1) {
+
+        pthread_mutex_lock(&viewer->lock);
+
+        while (viewer->count == 0 && viewer->running && !viewer->cycling) {
+            pthread_cond_wait(&viewer->changed, &viewer->lock);
+        }
+
+        if (!viewer->running) {
+            pthread_mutex_unlock(&viewer->lock);
+            break;
+        }
+
+        // Nothing's waiting, so move the palette along for the next redraw
+        if (viewer->count == 0) {
+            pthread_mutex_unlock(&viewer->lock);
+
+            brot_cycle_palette(brot, CYCLE_STEP);
+
+            if (brot_recolour(brot) != NULL) {
+                viewer_present(viewer);
+            } else {
+                // There's no finished frame to cycle the colours of
+                pthread_mutex_lock(&viewer->lock);
+                viewer->cycling = 0;
+                pthread_mutex_unlock(&viewer->lock);
+            }
+            continue;
+        }
 
-    if (err) {
-        printf("error %u: %s\n", err, lodepng_error_text(err));
+        command = viewer->queue[viewer->first];
+        viewer->first = (viewer->first + 1) % VIEWER_QUEUE;
+        viewer->count--;
+
+        if (viewer_moves(command.action)) {
+            viewer->moves--;
+        }
+
+        // Only let this frame finish if nothing after it moves the view again.
+        // Otherwise it's still started, which moves the view, and
+        // gives up before its first tile
+        atomic_store(&brot->cancel, viewer->moves > 0);
+
+        pthread_mutex_unlock(&viewer->lock);
+
+        switch (command.action) {
+        case VIEWER_CALCULATE:
+            done = brot_smooth_calculate(brot);
+            break;
+        case VIEWER_ZOOM:
+            done = brot_zoom(brot, command.x1, command.y1, command.x2, command.y2);
+            break;
+        case VIEWER_ZOOM_OUT:
+            done = brot_zoom_out(brot);
+            break;
+        case VIEWER_RESET:
+            done = brot_reset_zoom(brot);
+            break;
+        case VIEWER_PAN:
+            done = brot_pan(brot, command.xPixels, command.yPixels);
+            break;
+        case VIEWER_PNG:
+            // The last frame may have been cancelled by a move queued after this
+            if (brot->current->computed) {
+                render_png(brot, viewer->output_file);
+            }
+            done = NULL;
+            break;
+        case VIEWER_PALETTE:
+            viewer_next_palette(brot);
+            done = brot_recolour(brot);
+            break;
+        case VIEWER_COLOURING:
+            brot_set_colouring(brot, brot_colouring_name(brot->colouring == BROT_COLOUR_HISTOGRAM ?
+                                                         BROT_COLOUR_LINEAR : BROT_COLOUR_HISTOGRAM));
+            done = brot_recolour(brot);
+            break;
+        }
+
+        if (done != NULL) {
+            viewer_present(viewer);
+        }
     }
+
+    return NULL;
 }
 
+void viewer_pan(Viewer *viewer, int xPixels, int yPixels)
+{
+    Viewer_Command command = {VIEWER_PAN, 0, 0, 0, 0, xPixels, yPixels};
+
+    viewer_send(viewer, command);
+}
 
 int main(int argc, char* argv[])
 {
 
-    Args args = parse_args(argc, argv);
+    Args args = parse_args(argc, argv, 0);
 
     SDL_Surface *screen;
+    Screen_Format format;
     SDL_Event event;
 
+    Viewer viewer;
+    Viewer_Command command = {VIEWER_CALCULATE, 0, 0, 0, 0, 0, 0};
+
     int running = 1;
     double x1, x2, y1, y2;
-    double temp;
+    double temp, ratio;
 
     if (SDL_Init(SDL_INIT_VIDEO) < 0 ) {
         return 1;
@@ -133,80 +379,188 @@ int main(int argc, char* argv[])
         return 1;
     }
 
+    // Without SDL_ANYFORMAT the screen is always 32 bit, though not
+    // necessarily in the same order as the canvas
+    format = screen_format(screen);
+
     const SDL_VideoInfo* vidInfo = SDL_GetVideoInfo();
 
-    Mandelbrot brot = brot_create(vidInfo->current_w, vidInfo->current_h, 255, -2.5, -1.0, 1.0, 1.0);
+    // The viewer always fills the screen, so only the view
+    // and iterations are taken from the arguments
+    Mandelbrot brot = brot_create(vidInfo->current_w, vidInfo->current_h, args.repeats, args.x1, args.y1, args.x2, args.y2);
+
+    if (args.palette != NULL) {
+        brot_set_palette(brot, args.palette);
+    }
+
+    if (args.colouring != NULL) {
+        brot_set_colouring(brot, args.colouring);
+    }
+
+    viewer.brot = brot;
+    viewer.screen = screen;
+    viewer.output_file = args.output_file;
+    viewer.first = 0;
+    viewer.count = 0;
+    viewer.moves = 0;
+    viewer.presented = 0;
+    viewer.cycling = 0;
+    viewer.running = 1;
+
+    pthread_mutex_init(&viewer.lock, NULL);
+    pthread_cond_init(&viewer.changed, NULL);
+
+    brot->progress = draw_progress;
+    brot->progress_data = &viewer;
 
-    brot_smooth_calculate(brot);
+    // Everything to do with the brot happens on the render thread from here,
+    // this thread only handles events and draws what it's sent
+    viewer_send(&viewer, command);
 
-    draw_screen(brot, screen);
+    if (pthread_create(&viewer.thread, NULL, viewer_render, &viewer) != 0) {
+        SDL_Quit();
+        brot_cleanup(brot);
+        return 1;
+    }
 
-    while(running) {
-        while(SDL_PollEvent(&event)) {
+    while(running && SDL_WaitEvent(&event)) {
 
-            switch (event.type) {
+        switch (event.type) {
 
-            case SDL_QUIT:
+        case SDL_QUIT:
+            running = 0;
+            break;
+
+        case SDL_USEREVENT:
+            // The render thread is waiting while this is drawn
+            draw_screen(brot, screen, &format);
+
+            pthread_mutex_lock(&viewer.lock);
+            viewer.presented = 1;
+            pthread_cond_broadcast(&viewer.changed);
+            pthread_mutex_unlock(&viewer.lock);
+            break;
+
+        case SDL_KEYDOWN:
+            switch (event.key.keysym.sym) {
+            case SDLK_ESCAPE:
+                // Escape key
                 running = 0;
                 break;
-
-            case SDL_KEYDOWN:
-                switch (event.key.keysym.sym) {
-                case SDLK_ESCAPE:
-                    // Escape key
-                    running = 0;
-                    break;
-                case SDLK_p:
-                    // Write out png
-                    render_png(brot, args.output_file);
-                    break;
-                case SDLK_r:
-                    // Reset image
-                    brot_reset_zoom(brot);
-                    draw_screen(brot, screen);
-                    break;
-                default:
-                    break;
-                }
+            case SDLK_p:
+                // Write out png
+                command.action = VIEWER_PNG;
+                viewer_send(&viewer, command);
+                break;
+            case SDLK_r:
+                // Reset image
+                command.action = VIEWER_RESET;
+                viewer_send(&viewer, command);
+                break;
+            case SDLK_b:
+                // Back to the view before the last zoom
+                command.action = VIEWER_ZOOM_OUT;
+                viewer_send(&viewer, command);
+                break;
+            case SDLK_n:
+                // Next palette
+                command.action = VIEWER_PALETTE;
+                viewer_send(&viewer, command);
+                break;
+            case SDLK_e:
+                // Switch between histogram and linear colouring
+                command.action = VIEWER_COLOURING;
+                viewer_send(&viewer, command);
+                break;
+            case SDLK_c:
+                // Start or stop cycling the palette
+                pthread_mutex_lock(&viewer.lock);
+                viewer.cycling = !viewer.cycling;
+                pthread_cond_broadcast(&viewer.changed);
+                pthread_mutex_unlock(&viewer.lock);
+                break;
+            case SDLK_LEFT:
+                viewer_pan(&viewer, -PAN_STEP, 0);
+                break;
+            case SDLK_RIGHT:
+                viewer_pan(&viewer, PAN_STEP, 0);
+                break;
+            case SDLK_UP:
+                viewer_pan(&viewer, 0, -PAN_STEP);
+                break;
+            case SDLK_DOWN:
+                viewer_pan(&viewer, 0, PAN_STEP);
+                break;
+            default:
                 break;
+            }
+            break;
+
+        case SDL_MOUSEBUTTONDOWN:
+            x1 = (double)event.button.x/vidInfo->current_w;
+            y1 = (double)event.button.y/vidInfo->current_h;
+            break; 
+        case SDL_MOUSEBUTTONUP:
+            x2 = (double)event.button.x/vidInfo->current_w;
+            y2 = (double)event.button.y/vidInfo->current_h;
+
+            if (x1 > x2) {
+                temp = x2;
+                x2 = x1;
+                x1 = temp;
+            }
 
-            case SDL_MOUSEBUTTONDOWN:
-                x1 = (double)event.button.x/vidInfo->current_w;
-                y1 = (double)event.button.y/vidInfo->current_h;
-                break; 
-            case SDL_MOUSEBUTTONUP:
-                x2 = (double)event.button.x/vidInfo->current_w;
-                y2 = (double)event.button.y/vidInfo->current_h;
-
-                if (x1 > x2) {
-                    temp = x2;
-                    x2 = x1;
-                    x1 = temp;
-                }
-
-                if (y1 > y2) {
-                    temp = y2;
-                    y2 = y1;
-                    y1 = temp;
-                }
-
-                // Make sure the zoomed area always maintains the correct ratio.
-                // Because the values have already been scaled between 0 and 1
-                // we just need to make sure the area is a square
-                y2 = (x2 - x1) + y1;
-
-                brot_zoom(brot, x1, y1, x2, y2);
-                draw_screen(brot, screen);
-                break; 
+            if (y1 > y2) {
+                temp = y2;
+                y2 = y1;
+                y1 = temp;
+            }
+
+            // A click without any drag has nothing to zoom into
+            if (x2 == x1) {
+                break;
+            }
 
+            // When the selection is already close to a whole number ratio,
+            // snap it there. The corner is on a pixel, so every pixel of the
+            // current frame then lines up with one in the new frame and
+            // doesn't need calculating again
+            ratio = floor(1.0 / (x2 - x1) + 0.5);
+            if (fabs(vidInfo->current_w / ratio - (x2 - x1) * vidInfo->current_w) <= ZOOM_SNAP) {
+                x2 = x1 + 1.0 / ratio;
             }
+
+            // Make sure the zoomed area always maintains the correct ratio.
+            // Because the values have already been scaled between 0 and 1
+            // we just need to make sure the area is a square
+            y2 = (x2 - x1) + y1;
+
+            command.action = VIEWER_ZOOM;
+            command.x1 = x1;
+            command.y1 = y1;
+            command.x2 = x2;
+            command.y2 = y2;
+            viewer_send(&viewer, command);
+            break; 
+
         }
     }
 
+    // Stop the render thread, giving up on any frame it's part way through
+    pthread_mutex_lock(&viewer.lock);
+    viewer.running = 0;
+    atomic_store(&brot->cancel, 1);
+    pthread_cond_broadcast(&viewer.changed);
+    pthread_mutex_unlock(&viewer.lock);
+
+    pthread_join(viewer.thread, NULL);
+
+    pthread_mutex_destroy(&viewer.lock);
+    pthread_cond_destroy(&viewer.changed);
+
     SDL_Quit();
 
     brot_cleanup(brot);
 
     return 0;
 }
-
@@ -2,10 +2,172 @@
 #include <stdlib.h>
 #include <math.h>
 #include <stdint.h>
+#include <stdatomic.h>
+#include <time.h>
+#include <string.h>
 
 #include "mandelbrot.h"
+#include "pool.h"
+#include "kernel.h"
+#include "subdivide.h"
+#include "snapshot.h"
+#include "fixed.h"
+#include "perturb.h"
+#include "palette.h"
+
+// A piece of work for a thread, some or all of the rows of a tile
+typedef struct brot_work {
+    int tile;
+    int yStart;
+    int yEnd;
+
+    // The piece the same thread finished before this one, or -1
+    int next;
+} Brot_Work;
+
+// Shared state for calculating one frame across the thread pool
+typedef struct brot_frame {
+
+    Mandelbrot brot;
+
+    // Number of tiles across and down the image
+    int tilesX;
+    int tilesY;
+
+    // Every piece of work in the frame. It starts with one per tile and
+    // pieces get split in two when threads run out of work
+    Brot_Work *work;
+    int workCapacity;
+    atomic_int workCount;
+
+    // Pieces that haven't been finished yet, the frame is done at zero
+    atomic_int remaining;
+
+    // Threads that are currently looking for work
+    atomic_int idle;
+
+    // Threads that find nothing to do sleep on wake until more work is
+    // pushed or the frame is done. wakeups counts each time that happens,
+    // so a thread can tell whether it missed one while it was looking
+    pthread_mutex_t lock;
+    pthread_cond_t wake;
+    unsigned long wakeups;
+
+    // The pieces waiting to be picked up by each thread
+    Pool_Deque *deques;
+    int threadCount;
+
+    // The pieces each thread finished, as linked lists with the most
+    // recently finished first. threadWork holds the head for each thread
+    int *threadWork;
+
+    // The highest and lowest smooth values each thread has seen
+    double *highest;
+    double *lowest;
+
+    // For histogram colouring, each thread's count of the pixels that
+    // escaped after each number of iterations, bins apart. NULL otherwise
+    uint64_t *histograms;
+    int bins;
+
+    // The snapshot that was current before this frame
+    // Held on to so its values can be reused
+    Brot_Snapshot *previous;
+
+    // When pixels from the previous frame are being reused these give,
+    // for every column and row, the column or row of the previous frame
+    // that it lines up with, or -1 if it needs calculating
+    // Both are NULL when nothing is being reused
+    int *reuseX;
+    int *reuseY;
+
+    // For progressive frames, the gap between the pixels calculated in
+    // this pass and the one before it, or 0 if this is the first pass.
+    // A normal frame is a single pass with a step of 1
+    int step;
+    int coarse;
+
+    // Somewhere for each thread to put a pass's pixels from along a row
+    // before they are spread out into the planes
+    uint16_t *passFraction;
+    int *passRaw;
+
+} Brot_Frame;
+
+static double brot_now(void)
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return now.tv_sec + now.tv_nsec * 1e-9;
+}
+
+// Sets the full precision centre and the size of the view from the corners
+static void brot_view_from_corners(Mandelbrot brot)
+{
+    Brot_Fixed other;
+
+    brot->spanX = brot->x2 - brot->x1;
+    brot->spanY = brot->y1 - brot->y2;
+
+    int limbs = brot_fixed_limbs_for(brot_pixel_spacing(brot));
+
+    // Adding and halving is exact with enough limbs
+    brot_fixed_from_double(&brot->centerX, brot->x1, limbs);
+    brot_fixed_from_double(&other, brot->x2, limbs);
+    brot_fixed_add(&brot->centerX, &brot->centerX, &other);
+    brot_fixed_div_small(&brot->centerX, 2);
+
+    brot_fixed_from_double(&brot->centerY, brot->y1, limbs);
+    brot_fixed_from_double(&other, brot->y2, limbs);
+    brot_fixed_add(&brot->centerY, &brot->centerY, &other);
+    brot_fixed_div_small(&brot->centerY, 2);
+}
+
+// Raises the precision of the centre to what the current view needs
+static void brot_view_precision(Mandelbrot brot)
+{
+    int limbs = brot_fixed_limbs_for(brot_pixel_spacing(brot));
+
+    if (limbs > brot->centerX.limbs) {
+        brot_fixed_set_limbs(&brot->centerX, limbs);
+        brot_fixed_set_limbs(&brot->centerY, limbs);
+    }
+}
+
+// The kernel that calculates in the given precision
+static Brot_Kernel brot_precision_kernel(Mandelbrot brot, Brot_Precision precision)
+{
+    switch (precision) {
+        case BROT_PRECISION_PERTURB:
+            return brot_kernel_perturb;
+        case BROT_PRECISION_DOUBLE_DOUBLE:
+            return brot->dd_kernel;
+        case BROT_PRECISION_DOUBLE:
+            return brot->vector_kernel;
+        case BROT_PRECISION_FLOAT:
+        default:
+            return brot->float_kernel;
+    }
+}
+
+// Goes back to the precision a snapshot being swapped in was calculated in,
+// so it gets stamped and reported with that. Anything calculated after this
+// goes through brot_select_kernel, which sets up the reference orbit
+static void brot_snapshot_precision(Mandelbrot brot, Brot_Snapshot *snapshot)
+{
+    brot->precision = snapshot->precision;
+    brot->kernel = brot_precision_kernel(brot, snapshot->precision);
+}
 
 Mandelbrot brot_create(int pixelWidth, int pixelHeight, int repeats, double x1, double y1, double x2, double y2)
+{
+    return brot_create_threads(pixelWidth, pixelHeight, repeats, x1, y1, x2, y2, 0);
+}
+
+Mandelbrot brot_create_threads(int pixelWidth, int pixelHeight, int repeats, double x1, double y1, double x2, double y2,
+                               int threads)
 {
     Mandelbrot brot = (Mandelbrot) malloc(sizeof(Mandelbrot_Data));
 
@@ -24,22 +186,52 @@ Mandelbrot brot_create(int pixelWidth, int pixelHeight, int repeats, double x1,
     brot->pixelWidth = pixelWidth;
     brot->pixelHeight = pixelHeight;
 
-    brot->canvas = (uint32_t**) malloc(sizeof(uint32_t*) * brot->pixelWidth);
-
-    brot->smooth_values = (double**) malloc(sizeof(double*) * brot->pixelWidth);
+    brot_view_from_corners(brot);
 
     brot->repeats = repeats;
 
-    // Assign the memory for the canvas
-    // Actually done as an array of pointers to arrays of ints
-    for (int i = 0; i < brot->pixelWidth; i++) {
-        brot->canvas[i] = (uint32_t*) malloc(sizeof(uint32_t*) * brot->pixelHeight);
-    }
+    brot->interior_check = 1;
 
-    // Assign the memory for the smooth value array
-    for (int i = 0; i < brot->pixelWidth; i++) {
-        brot->smooth_values[i] = (double*) malloc(sizeof(double*) * brot->pixelHeight);
-    }
+    brot->periodicity_check = 1;
+
+    brot->render_mode = BROT_RENDER_FULL;
+
+    brot->reused_pixels = 0;
+
+    // Pad the rows so they all start on a cache line, for both
+    // the 2 byte and 4 byte planes
+    int rowAlign = BROT_PLANE_ALIGN / sizeof(uint16_t);
+    brot->stride = ((pixelWidth + rowAlign - 1) / rowAlign) * rowAlign;
+
+    brot->current = NULL;
+    brot->home = NULL;
+    brot->history_count = 0;
+    brot->spare = NULL;
+
+    brot_snapshot_use(brot, brot_snapshot_create(brot));
+
+    brot->pool = pool_create(threads);
+
+    brot->thread_stats = NULL;
+    brot->thread_count = 0;
+
+    brot->progress = NULL;
+    brot->progress_data = NULL;
+
+    atomic_init(&brot->cancel, 0);
+
+    brot->vector_kernel = brot_kernel_select(&brot->isa);
+    brot->float_kernel = brot_kernel_float(brot->isa);
+    brot->dd_kernel = brot_kernel_dd(brot->isa);
+    brot->kernel = brot->vector_kernel;
+
+    brot->precision = BROT_PRECISION_DOUBLE;
+    brot->reference = NULL;
+    atomic_init(&brot->glitches, 0);
+
+    brot->palette = brot_palette_named(BROT_DEFAULT_PALETTE);
+    brot->colouring = BROT_COLOUR_HISTOGRAM;
+    brot->palette_version = 0;
 
     return brot;
 }
@@ -68,68 +260,1055 @@ Mandelbrot brot_zoom(Mandelbrot brot, double x1, double y1, double x2, double y2
     brot->x2 = x2Brot;
     brot->y2 = y2Brot;
 
-    brot_smooth_calculate(brot);
+    // Move the full precision centre by the offset of the middle of
+    // the zoomed area, with the precision raised for the new view first
+    double xOffset = brot->spanX * ((x1 + x2) / 2 - 0.5);
+    double yOffset = -brot->spanY * ((y1 + y2) / 2 - 0.5);
 
-    return brot;
+    brot->spanX *= (x2 - x1);
+    brot->spanY *= (y2 - y1);
+
+    brot_view_precision(brot);
+
+    brot_fixed_add_double(&brot->centerX, xOffset);
+    brot_fixed_add_double(&brot->centerY, yOffset);
+
+    brot_history_push(brot);
+
+    return brot_smooth_calculate(brot);
 }
 
 Mandelbrot brot_reset_zoom(Mandelbrot brot)
 {
+    // Resetting can be undone by zooming back out
+    brot_history_push(brot);
+
     brot->x1 = brot->startX1;
     brot->y1 = brot->startY1;
 
     brot->x2 = brot->startX2;
     brot->y2 = brot->startY2;
 
-    brot_smooth_calculate(brot);
+    brot_view_from_corners(brot);
+
+    if (brot->home != NULL && brot_snapshot_matches(brot, brot->home)) {
+        brot_snapshot_retain(brot->home);
+        brot_snapshot_use(brot, brot->home);
+        brot_snapshot_precision(brot, brot->home);
+
+        if (brot->home->palette_version != brot->palette_version) {
+            return brot_recolour(brot);
+        }
+        return brot;
+    }
+
+    // The settings have changed since the home view was calculated
+    if (brot->home != NULL) {
+        brot_snapshot_release(brot, brot->home);
+        brot->home = NULL;
+    }
+
+    return brot_smooth_calculate(brot);
+}
+
+Mandelbrot brot_set_view(Mandelbrot brot, const char *centerX, const char *centerY, double width)
+{
+    Brot_Fixed x, y;
+
+    double height = width * brot->pixelHeight / brot->pixelWidth;
+
+    int limbs = brot_fixed_limbs_for(width / brot->pixelWidth);
+
+    if (!brot_fixed_from_string(&x, centerX, limbs) || !brot_fixed_from_string(&y, centerY, limbs)) {
+        return NULL;
+    }
+
+    brot->centerX = x;
+    brot->centerY = y;
+
+    // y1 is the bottom of the view, same as brot_create
+    brot->spanX = width;
+    brot->spanY = -height;
+
+    brot->x1 = brot_fixed_to_double(&x) - width / 2;
+    brot->x2 = brot_fixed_to_double(&x) + width / 2;
+
+    brot->y1 = brot_fixed_to_double(&y) - height / 2;
+    brot->y2 = brot_fixed_to_double(&y) + height / 2;
 
     return brot;
 }
 
-Mandelbrot brot_smooth_calculate(Mandelbrot brot)
+Mandelbrot brot_set_palette(Mandelbrot brot, const char *name)
 {
-    double highest = 0.0;
-    double lowest = 1000;
-    double value;
+    Brot_Palette *palette = brot_palette_named(name);
 
-    // Calculate mandelbrot values
-    for (int xPos = 0; xPos < brot->pixelWidth; xPos++) {
-        for (int yPos = 0; yPos < brot->pixelHeight; yPos++) {
-            value = brot_calc_smooth_value(brot, xPos, yPos);
-            if (value > highest) {
-                highest = value;
+    if (palette == NULL) {
+        return NULL;
+    }
+
+    brot_palette_free(brot->palette);
+    brot->palette = palette;
+    brot->palette_version++;
+
+    return brot;
+}
+
+Mandelbrot brot_set_colouring(Mandelbrot brot, const char *name)
+{
+    Brot_Colouring colourings[] = {BROT_COLOUR_HISTOGRAM, BROT_COLOUR_LINEAR};
+
+    for (int i = 0; i < 2; i++) {
+        if (strcmp(name, brot_colouring_name(colourings[i])) == 0) {
+            brot->colouring = colourings[i];
+            brot->palette_version++;
+            return brot;
+        }
+    }
+
+    return NULL;
+}
+
+Mandelbrot brot_cycle_palette(Mandelbrot brot, int steps)
+{
+    brot_palette_cycle(brot->palette, steps);
+    brot->palette_version++;
+
+    return brot;
+}
+
+Mandelbrot brot_zoom_out(Mandelbrot brot)
+{
+    Brot_Snapshot *snapshot = brot_history_pop(brot);
+
+    if (snapshot == NULL) {
+        return brot;
+    }
+
+    brot->x1 = snapshot->x1;
+    brot->y1 = snapshot->y1;
+
+    brot->x2 = snapshot->x2;
+    brot->y2 = snapshot->y2;
+
+    brot->centerX = snapshot->centerX;
+    brot->centerY = snapshot->centerY;
+    brot->spanX = snapshot->spanX;
+    brot->spanY = snapshot->spanY;
+
+    brot_snapshot_use(brot, snapshot);
+    brot_snapshot_precision(brot, snapshot);
+
+    if (!brot_snapshot_matches(brot, snapshot)) {
+        return brot_smooth_calculate(brot);
+    }
+
+    // The palette has changed since it was coloured
+    if (snapshot->palette_version != brot->palette_version) {
+        return brot_recolour(brot);
+    }
+
+    return brot;
+}
+
+Mandelbrot brot_pan(Mandelbrot brot, int xPixels, int yPixels)
+{
+    double xShift = (brot->x2 - brot->x1) * ((double)xPixels / brot->pixelWidth);
+    double yShift = (brot->y1 - brot->y2) * ((double)yPixels / brot->pixelHeight);
+
+    // Moving the view right and down, in screen terms
+    brot->x1 += xShift;
+    brot->x2 += xShift;
+
+    brot->y1 -= yShift;
+    brot->y2 -= yShift;
+
+    brot_fixed_add_double(&brot->centerX, brot->spanX * ((double)xPixels / brot->pixelWidth));
+    brot_fixed_add_double(&brot->centerY, -brot->spanY * ((double)yPixels / brot->pixelHeight));
+
+    return brot_smooth_calculate(brot);
+}
+
+// Works out which pixel of the previous frame each pixel along one
+// axis of the new frame lines up with, giving -1 where none does
+// Returns how many of them line up
+static int brot_reuse_map(double newStart, double newEnd, double oldStart, double oldEnd, int pixels, int *map)
+{
+    int found = 0;
+    double pos, oldPixel, nearest;
+
+    for (int i = 0; i < pixels; i++) {
+        pos = newStart + ((newEnd - newStart) * ((double)i / pixels));
+
+        oldPixel = ((pos - oldStart) / (oldEnd - oldStart)) * pixels;
+        nearest = floor(oldPixel + 0.5);
+
+        if (fabs(oldPixel - nearest) < BROT_REUSE_TOLERANCE && nearest >= 0 && nearest < pixels) {
+            map[i] = (int)nearest;
+            found++;
+        } else {
+            map[i] = -1;
+        }
+    }
+
+    return found;
+}
+
+// Sets up the frame to reuse the previous frame's values if any of its
+// pixels line up with the new view
+static void brot_reuse_setup(Brot_Frame *frame)
+{
+    Mandelbrot brot = frame->brot;
+    Brot_Snapshot *previous = frame->previous;
+
+    frame->reuseX = NULL;
+    frame->reuseY = NULL;
+
+    brot->reused_pixels = 0;
+
+    // Subdivision decides what to calculate itself, and deep views
+    // can't be lined up using the corner coordinates. Values from
+    // another precision wouldn't match a fresh calculation either
+    if (!brot_snapshot_matches(brot, previous) || brot->render_mode != BROT_RENDER_FULL ||
+        brot->precision >= BROT_PRECISION_DOUBLE_DOUBLE || previous->precision != brot->precision) {
+        return;
+    }
+
+    int *reuseX = (int*) malloc(sizeof(int) * brot->pixelWidth);
+    int *reuseY = (int*) malloc(sizeof(int) * brot->pixelHeight);
+
+    int columns = brot_reuse_map(brot->x1, brot->x2, previous->x1, previous->x2, brot->pixelWidth, reuseX);
+    int rows = brot_reuse_map(brot->y1, brot->y2, previous->y1, previous->y2, brot->pixelHeight, reuseY);
+
+    if (columns == 0 || rows == 0) {
+        free(reuseX);
+        free(reuseY);
+        return;
+    }
+
+    frame->reuseX = reuseX;
+    frame->reuseY = reuseY;
+
+    brot->reused_pixels = (long)columns * rows;
+}
+
+// Fills in part of a row that lines up with a row of the previous frame,
+// copying the pixels that line up and calculating the rest
+static void brot_reuse_span(Brot_Frame *frame, int yPos, int xStart, int xEnd)
+{
+    Mandelbrot brot = frame->brot;
+
+    int *reuseX = frame->reuseX;
+
+    uint16_t *fraction = brot->fraction_values + yPos * brot->stride;
+    int *raw = brot->raw_values + yPos * brot->stride;
+
+    uint16_t *oldFraction = frame->previous->fraction_values + frame->reuseY[yPos] * brot->stride;
+    int *oldRaw = frame->previous->raw_values + frame->reuseY[yPos] * brot->stride;
+
+    int xPos = xStart;
+    int runStart;
+
+    while (xPos < xEnd) {
+        if (reuseX[xPos] >= 0) {
+            fraction[xPos] = oldFraction[reuseX[xPos]];
+            raw[xPos] = oldRaw[reuseX[xPos]];
+            xPos++;
+        } else {
+            runStart = xPos;
+            while (xPos < xEnd && reuseX[xPos] < 0) {
+                xPos++;
+            }
+            brot->kernel(brot, runStart, yPos, xPos - runStart, 1, fraction + runStart, raw + runStart);
+        }
+    }
+}
+
+// Gets the pixel bounds of a tile, clipped to the edges of the image
+static void brot_tile_bounds(Brot_Frame *frame, int tile, int *xStart, int *yStart, int *xEnd, int *yEnd)
+{
+    Mandelbrot brot = frame->brot;
+
+    *xStart = (tile % frame->tilesX) * BROT_TILE_SIZE;
+    *yStart = (tile / frame->tilesX) * BROT_TILE_SIZE;
+
+    *xEnd = *xStart + BROT_TILE_SIZE;
+    *yEnd = *yStart + BROT_TILE_SIZE;
+
+    if (*xEnd > brot->pixelWidth) {
+        *xEnd = brot->pixelWidth;
+    }
+    if (*yEnd > brot->pixelHeight) {
+        *yEnd = brot->pixelHeight;
+    }
+}
+
+void brot_span_stats(Mandelbrot brot, const int *raw, const uint16_t *fraction, int count,
+                     double *highest, double *lowest)
+{
+    // The iteration and fraction together as one number goes up with the
+    // smooth value, so only the ends need to be turned back into values
+    const int64_t zero = (int64_t)BROT_FRACTION_OFFSET * BROT_FRACTION_ONE;
+
+    int64_t high = INT64_MIN;
+    int64_t low = INT64_MAX;
+    int64_t key;
+
+    for (int i = 0; i < count; i++) {
+        if (raw[i] >= brot->repeats) {
+            continue;
+        }
+
+        key = (int64_t)raw[i] * BROT_FRACTION_ONE + fraction[i];
+
+        if (key > high) {
+            high = key;
+        }
+        if (key > zero && key < low) {
+            low = key;
+        }
+    }
+
+    if (high != INT64_MIN && (double)(high - zero) / BROT_FRACTION_ONE > *highest) {
+        *highest = (double)(high - zero) / BROT_FRACTION_ONE;
+    }
+    if (low != INT64_MAX && (double)(low - zero) / BROT_FRACTION_ONE < *lowest) {
+        *lowest = (double)(low - zero) / BROT_FRACTION_ONE;
+    }
+}
+
+// Adds a piece of work for part of a tile to the frame
+static int brot_work_add(Brot_Frame *frame, int tile, int yStart, int yEnd)
+{
+    int index = atomic_fetch_add(&frame->workCount, 1);
+    Brot_Work *work = &frame->work[index];
+
+    work->tile = tile;
+    work->yStart = yStart;
+    work->yEnd = yEnd;
+    work->next = -1;
+
+    return index;
+}
+
+// Adds pixels to the thread's histogram, if the frame is keeping them
+static void brot_span_histogram(Brot_Frame *frame, int thread, const int *raw, int count)
+{
+    if (frame->histograms != NULL) {
+        brot_histogram_add(frame->histograms + (size_t)thread * frame->bins, frame->brot->repeats, raw, count);
+    }
+}
+
+// Calculates the pixels along a row of a tile that are new in this pass.
+// Rows that had pixels in the last pass only need the ones in between,
+// every other row of the pass needs all of its pixels step apart
+static void brot_pass_row(Brot_Frame *frame, int thread, int yPos, int xStart, int xEnd,
+                          double *highest, double *lowest)
+{
+    Mandelbrot brot = frame->brot;
+
+    uint16_t *fraction = frame->passFraction + thread * BROT_TILE_SIZE;
+    int *raw = frame->passRaw + thread * BROT_TILE_SIZE;
+
+    int first = 0;
+    int every = frame->step;
+
+    if (yPos % frame->step != 0) {
+        return;
+    }
+
+    if (frame->coarse > 0 && yPos % frame->coarse == 0) {
+        first = frame->step;
+        every = frame->coarse;
+    }
+
+    int count = (xEnd - xStart - first + every - 1) / every;
+
+    if (count <= 0) {
+        return;
+    }
+
+    brot->kernel(brot, xStart + first, yPos, count, every, fraction, raw);
+
+    uint16_t *rowFraction = brot->fraction_values + yPos * brot->stride + xStart + first;
+    int *rowRaw = brot->raw_values + yPos * brot->stride + xStart + first;
+
+    for (int i = 0; i < count; i++) {
+        rowFraction[i * every] = fraction[i];
+        rowRaw[i * every] = raw[i];
+    }
+
+    brot_span_stats(brot, raw, fraction, count, highest, lowest);
+    brot_span_histogram(frame, thread, raw, count);
+}
+
+// Calculates the rows of a tile that a piece of work covers
+static void brot_work_calculate(Brot_Frame *frame, int thread, Brot_Work *work, double *highest, double *lowest)
+{
+    Mandelbrot brot = frame->brot;
+
+    int xStart, yStart, xEnd, yEnd;
+    uint16_t *fraction;
+    int *raw;
+
+    brot_tile_bounds(frame, work->tile, &xStart, &yStart, &xEnd, &yEnd);
+
+    if (frame->step > 1 || frame->coarse > 0) {
+        for (int yPos = work->yStart; yPos < work->yEnd; yPos++) {
+            brot_pass_row(frame, thread, yPos, xStart, xEnd, highest, lowest);
+        }
+    } else if (brot->render_mode == BROT_RENDER_FULL) {
+        for (int yPos = work->yStart; yPos < work->yEnd; yPos++) {
+            fraction = brot->fraction_values + yPos * brot->stride + xStart;
+            raw = brot->raw_values + yPos * brot->stride + xStart;
+            if (frame->reuseY != NULL && frame->reuseY[yPos] >= 0) {
+                brot_reuse_span(frame, yPos, xStart, xEnd);
+            } else {
+                brot->kernel(brot, xStart, yPos, xEnd - xStart, 1, fraction, raw);
+            }
+            brot_span_stats(brot, raw, fraction, xEnd - xStart, highest, lowest);
+            brot_span_histogram(frame, thread, raw, xEnd - xStart);
+        }
+    } else {
+        // Subdivision needs the whole tile, so these never get split
+        brot_subdivide_tile(brot, xStart, yStart, xEnd, yEnd);
+        for (int yPos = yStart; yPos < yEnd; yPos++) {
+            fraction = brot->fraction_values + yPos * brot->stride + xStart;
+            raw = brot->raw_values + yPos * brot->stride + xStart;
+            brot_span_stats(brot, raw, fraction, xEnd - xStart, highest, lowest);
+            brot_span_histogram(frame, thread, raw, xEnd - xStart);
+        }
+    }
+}
+
+// Looks for work on the other threads' deques, starting with the next thread along
+static int brot_work_steal(Brot_Frame *frame, int thread)
+{
+    int item;
+
+    for (int i = 1; i < frame->threadCount; i++) {
+        item = pool_deque_steal(&frame->deques[(thread + i) % frame->threadCount]);
+        if (item >= 0) {
+            return item;
+        }
+    }
+
+    return -1;
+}
+
+// Wakes any threads waiting for work
+static void brot_frame_wake(Brot_Frame *frame)
+{
+    pthread_mutex_lock(&frame->lock);
+    frame->wakeups++;
+    pthread_cond_broadcast(&frame->wake);
+    pthread_mutex_unlock(&frame->lock);
+}
+
+// Sleeps until there's been a wake up since the one in seen,
+// unless the frame is already done
+static void brot_frame_wait(Brot_Frame *frame, unsigned long *seen)
+{
+    pthread_mutex_lock(&frame->lock);
+    while (frame->wakeups == *seen && atomic_load(&frame->remaining) > 0) {
+        pthread_cond_wait(&frame->wake, &frame->lock);
+    }
+    *seen = frame->wakeups;
+    pthread_mutex_unlock(&frame->lock);
+}
+
+// Thread task that calculates the frame. Each thread works through its own
+// deque and steals from the others when it runs out. When a thread picks up
+// a piece while others are waiting and it has nothing else queued, it splits
+// the piece in half and leaves one half for them to steal
+static void brot_calculate_tiles(void *arg, int thread)
+{
+    Brot_Frame *frame = (Brot_Frame*) arg;
+    Mandelbrot brot = frame->brot;
+    Brot_Thread_Stats *stats = &brot->thread_stats[thread];
+
+    Pool_Deque *own = &frame->deques[thread];
+    Brot_Work *work;
+
+    int item, half, split;
+    int idle = 0;
+    unsigned long seen = 0;
+
+    double started = brot_now();
+    double now;
+
+    while (1) {
+
+        item = pool_deque_pop(own);
+
+        if (item < 0) {
+            item = brot_work_steal(frame, thread);
+            if (item >= 0) {
+                stats->steals++;
+            }
+        }
+
+        if (item < 0) {
+            if (atomic_load(&frame->remaining) == 0) {
+                break;
+            }
+            if (!idle) {
+                atomic_fetch_add(&frame->idle, 1);
+                idle = 1;
+            }
+            brot_frame_wait(frame, &seen);
+            continue;
+        }
+
+        if (idle) {
+            atomic_fetch_sub(&frame->idle, 1);
+            idle = 0;
+        }
+
+        now = brot_now();
+        stats->idle += now - started;
+        started = now;
+
+        work = &frame->work[item];
+
+        // Once the frame is cancelled the rest of the work is just used up
+        if (atomic_load(&brot->cancel)) {
+            if (atomic_fetch_sub(&frame->remaining, 1) == 1) {
+                brot_frame_wake(frame);
             }
-            if (value > 0 && value < lowest) {
-                lowest = value;
+            continue;
+        }
+
+        split = 0;
+
+        while (brot->render_mode == BROT_RENDER_FULL &&
+               work->yEnd - work->yStart >= 2 * BROT_SPLIT_ROWS &&
+               atomic_load(&frame->idle) > 0 &&
+               pool_deque_empty(own)) {
+
+            half = (work->yStart + work->yEnd) / 2;
+
+            atomic_fetch_add(&frame->remaining, 1);
+            pool_deque_push(own, brot_work_add(frame, work->tile, half, work->yEnd));
+
+            work->yEnd = half;
+            split = 1;
+        }
+
+        if (split) {
+            brot_frame_wake(frame);
+        }
+
+        brot_work_calculate(frame, thread, work, &frame->highest[thread], &frame->lowest[thread]);
+
+        work->next = frame->threadWork[thread];
+        frame->threadWork[thread] = item;
+
+        stats->pieces++;
+
+        if (atomic_fetch_sub(&frame->remaining, 1) == 1) {
+            brot_frame_wake(frame);
+        }
+
+        now = brot_now();
+        stats->busy += now - started;
+        started = now;
+    }
+
+    stats->idle += brot_now() - started;
+}
+
+// Colours the pixels a preview pass has so far as blocks the size of the step
+static void brot_colour_preview(Brot_Frame *frame, Brot_Work *work, int xStart, int xEnd, int yEnd)
+{
+    Mandelbrot brot = frame->brot;
+
+    int step = frame->step;
+    uint32_t colour;
+    uint32_t *colours;
+
+    for (int yPos = work->yStart; yPos < work->yEnd; yPos++) {
+
+        if (yPos % step != 0) {
+            continue;
+        }
+
+        uint16_t *fraction = brot->fraction_values + yPos * brot->stride;
+        int *raw = brot->raw_values + yPos * brot->stride;
+        int blockEnd = yPos + step < yEnd ? yPos + step : yEnd;
+
+        for (int xPos = xStart; xPos < xEnd; xPos += step) {
+            colour = raw[xPos] < brot->repeats ?
+                     brot_palette_colour(brot->palette, brot->current->scale,
+                                         brot_fraction_value(brot->repeats, raw[xPos], fraction[xPos])) : 0;
+
+            for (int y = yPos; y < blockEnd; y++) {
+                colours = brot->canvas + y * brot->stride;
+                for (int x = xPos; x < xPos + step && x < xEnd; x++) {
+                    colours[x] = colour;
+                }
             }
-            brot->smooth_values[xPos][yPos] = value;
         }
     }
+}
+
+// Thread task that scales the values of each piece of work along the palette
+// and turns them into colours in a single pass
+// Each thread colours the pieces it calculated, newest first,
+// so the values are usually still in its cache
+static void brot_colour_tiles(void *arg, int thread)
+{
+    Brot_Frame *frame = (Brot_Frame*) arg;
+    Mandelbrot brot = frame->brot;
+
+    int xStart, yStart, xEnd, yEnd;
+
+    size_t offset;
+
+    for (int item = frame->threadWork[thread]; item >= 0; item = frame->work[item].next) {
+
+        Brot_Work *work = &frame->work[item];
+
+        brot_tile_bounds(frame, work->tile, &xStart, &yStart, &xEnd, &yEnd);
+
+        if (frame->step > 1) {
+            brot_colour_preview(frame, work, xStart, xEnd, yEnd);
+            continue;
+        }
+
+        for (int yPos = work->yStart; yPos < work->yEnd; yPos++) {
+            offset = (size_t)yPos * brot->stride + xStart;
+            brot_palette_span(brot->palette, brot->isa, brot->current->scale, brot->repeats, brot->raw_values + offset,
+                              brot->fraction_values + offset, brot->canvas + offset, xEnd - xStart);
+        }
+    }
+}
+
+// Hands out the work for a pass over the frame, one piece per tile,
+// with each thread's deque getting a run of neighbouring tiles
+static void brot_frame_fill(Brot_Frame *frame)
+{
+    Mandelbrot brot = frame->brot;
+
+    int tileCount = frame->tilesX * frame->tilesY;
+    int threadCount = frame->threadCount;
+
+    atomic_store(&frame->workCount, 0);
+    atomic_store(&frame->remaining, tileCount);
+    atomic_store(&frame->idle, 0);
+    frame->wakeups = 0;
+
+    for (int thread = 0; thread < threadCount; thread++) {
+
+        frame->threadWork[thread] = -1;
+
+        // Pushed last first so the owner starts at the top of its run
+        // and thieves take from the far end
+        int first = (long)tileCount * thread / threadCount;
+        int last = (long)tileCount * (thread + 1) / threadCount;
+
+        for (int tile = last - 1; tile >= first; tile--) {
+            int yStart = (tile / frame->tilesX) * BROT_TILE_SIZE;
+            int yEnd = yStart + BROT_TILE_SIZE < brot->pixelHeight ? yStart + BROT_TILE_SIZE : brot->pixelHeight;
+
+            pool_deque_push(&frame->deques[thread], brot_work_add(frame, tile, yStart, yEnd));
+        }
+    }
+}
+
+static void brot_frame_init(Brot_Frame *frame, Mandelbrot brot)
+{
+    frame->brot = brot;
+
+    frame->tilesX = (brot->pixelWidth + BROT_TILE_SIZE - 1) / BROT_TILE_SIZE;
+    frame->tilesY = (brot->pixelHeight + BROT_TILE_SIZE - 1) / BROT_TILE_SIZE;
+
+    int tileCount = frame->tilesX * frame->tilesY;
+    int threadCount = brot->pool->count > 0 ? brot->pool->count : 1;
+
+    // Splitting stops at BROT_SPLIT_ROWS, so a tile can't end up in more pieces than this
+    frame->workCapacity = tileCount * (BROT_TILE_SIZE / BROT_SPLIT_ROWS);
+    frame->work = (Brot_Work*) malloc(sizeof(Brot_Work) * frame->workCapacity);
+
+    frame->threadCount = threadCount;
+    frame->deques = (Pool_Deque*) malloc(sizeof(Pool_Deque) * threadCount);
+    frame->threadWork = (int*) malloc(sizeof(int) * threadCount);
+    frame->highest = (double*) malloc(sizeof(double) * threadCount);
+    frame->lowest = (double*) malloc(sizeof(double) * threadCount);
+
+    frame->passFraction = (uint16_t*) malloc(sizeof(uint16_t) * BROT_TILE_SIZE * threadCount);
+    frame->passRaw = (int*) malloc(sizeof(int) * BROT_TILE_SIZE * threadCount);
+
+    frame->histograms = NULL;
+    frame->bins = brot_histogram_bins(brot->repeats);
+
+    if (brot->colouring == BROT_COLOUR_HISTOGRAM) {
+        frame->histograms = (uint64_t*) calloc((size_t)frame->bins * threadCount, sizeof(uint64_t));
+    }
+
+    if (brot->thread_count != threadCount) {
+        free(brot->thread_stats);
+        brot->thread_stats = (Brot_Thread_Stats*) malloc(sizeof(Brot_Thread_Stats) * threadCount);
+        brot->thread_count = threadCount;
+    }
+
+    for (int thread = 0; thread < threadCount; thread++) {
+        pool_deque_init(&frame->deques[thread], frame->workCapacity);
+
+        frame->highest[thread] = 0.0;
+        frame->lowest[thread] = 1000;
+
+        brot->thread_stats[thread].busy = 0;
+        brot->thread_stats[thread].idle = 0;
+        brot->thread_stats[thread].pieces = 0;
+        brot->thread_stats[thread].steals = 0;
+    }
+
+    pthread_mutex_init(&frame->lock, NULL);
+    pthread_cond_init(&frame->wake, NULL);
+
+    frame->step = 1;
+    frame->coarse = 0;
+
+    frame->reuseX = NULL;
+    frame->reuseY = NULL;
+
+    brot_frame_fill(frame);
+}
+
+static void brot_frame_free(Brot_Frame *frame)
+{
+    for (int thread = 0; thread < frame->threadCount; thread++) {
+        pool_deque_free(&frame->deques[thread]);
+    }
+
+    pthread_mutex_destroy(&frame->lock);
+    pthread_cond_destroy(&frame->wake);
+
+    free(frame->work);
+    free(frame->deques);
+    free(frame->threadWork);
+    free(frame->highest);
+    free(frame->lowest);
+    free(frame->passFraction);
+    free(frame->passRaw);
+    free(frame->histograms);
+}
+
+// Merges the thread values so the whole frame is scaled the same way
+static void brot_frame_merge(Brot_Frame *frame)
+{
+    double highest = 0.0;
+    double lowest = 1000;
+
+    for (int thread = 0; thread < frame->threadCount; thread++) {
+        if (frame->highest[thread] > highest) {
+            highest = frame->highest[thread];
+        }
+        if (frame->lowest[thread] < lowest) {
+            lowest = frame->lowest[thread];
+        }
+    }
+
+    // Kept with the planes, so the canvas can be coloured again
+    Brot_Colour_Scale *scale = frame->brot->current->scale;
+
+    // Left over from an earlier frame in the same planes, or the
+    // last pass of a progressive frame
+    brot_colour_scale_free(scale);
+
+    if (frame->histograms == NULL) {
+        brot_colour_scale_linear(scale, highest, lowest);
+        return;
+    }
+
+    // The threads' histograms carry on between passes, so they're summed somewhere else
+    uint64_t *counts = (uint64_t*) calloc(frame->bins, sizeof(uint64_t));
+
+    for (int thread = 0; thread < frame->threadCount; thread++) {
+        uint64_t *histogram = frame->histograms + (size_t)thread * frame->bins;
+        for (int bin = 0; bin < frame->bins; bin++) {
+            counts[bin] += histogram[bin];
+        }
+    }
+
+    brot_colour_scale_histogram(scale, counts, frame->brot->repeats);
+
+    free(counts);
+}
+
+// Colours the finished frame and records what the planes now hold
+static void brot_frame_colour(Brot_Frame *frame)
+{
+    Mandelbrot brot = frame->brot;
+
+    brot_frame_merge(frame);
+
+    // Scale and colour the tiles
+    pool_run(brot->pool, brot_colour_tiles, frame);
+
+    brot_snapshot_stamp(brot, brot->current);
+    brot->current->palette_version = brot->palette_version;
+
+    // Keep the first frame at the start coordinates for resetting to
+    if (brot->home == NULL &&
+        brot->x1 == brot->startX1 && brot->y1 == brot->startY1 &&
+        brot->x2 == brot->startX2 && brot->y2 == brot->startY2) {
+        brot_snapshot_retain(brot->current);
+        brot->home = brot->current;
+    }
+}
+
+void brot_pick_precision(Mandelbrot brot)
+{
+    double spacing = brot_pixel_spacing(brot);
+
+    if (spacing < BROT_DEEP_SPACING) {
+        brot->precision = BROT_PRECISION_PERTURB;
+    } else if (spacing < BROT_DOUBLE_SPACING) {
+        brot->precision = BROT_PRECISION_DOUBLE_DOUBLE;
+    } else if (spacing < BROT_FLOAT_SPACING) {
+        brot->precision = BROT_PRECISION_DOUBLE;
+    } else {
+        brot->precision = BROT_PRECISION_FLOAT;
+    }
+}
+
+void brot_select_kernel(Mandelbrot brot)
+{
+    brot_pick_precision(brot);
+
+    brot->kernel = brot_precision_kernel(brot, brot->precision);
+
+    if (brot->precision == BROT_PRECISION_PERTURB) {
+        atomic_store(&brot->glitches, 0);
+        brot_reference_update(brot);
+    } else if (brot->precision == BROT_PRECISION_DOUBLE_DOUBLE) {
+        brot_fixed_to_dd(&brot->centerX, &brot->ddCenterX);
+        brot_fixed_to_dd(&brot->centerY, &brot->ddCenterY);
+    }
+}
+
+Mandelbrot brot_smooth_calculate(Mandelbrot brot)
+{
+    Brot_Frame frame;
+
+    brot_frame_init(&frame, brot);
+
+    // Pick the kernel for this frame from how far apart the pixels are
+    brot_select_kernel(brot);
+
+    frame.previous = brot->current;
+    brot_snapshot_retain(frame.previous);
+
+    brot_reuse_setup(&frame);
+
+    // The planes can only be written over if nothing else is using them,
+    // otherwise the frame goes into a fresh set
+    if (frame.reuseX != NULL || frame.previous->refs > 2) {
+        brot_snapshot_use(brot, brot_snapshot_get(brot));
+    }
+
+    // Show rough versions of the frame first if anyone is watching.
+    // Each pass fills in the pixels between the last pass's ones.
+    // Frames reusing the last one are mostly done already so don't bother
+    if (brot->progress != NULL && brot->render_mode == BROT_RENDER_FULL && frame.reuseX == NULL) {
+        for (frame.step = BROT_PREVIEW_STEP; frame.step > 1; frame.step /= 2) {
+            pool_run(brot->pool, brot_calculate_tiles, &frame);
+
+            if (atomic_load(&brot->cancel)) {
+                break;
+            }
+
+            brot_frame_merge(&frame);
+            pool_run(brot->pool, brot_colour_tiles, &frame);
 
-    // scaling from 0 to 360
-    for (int xPos = 0; xPos < brot->pixelWidth; xPos++) {
-        for (int yPos = 0; yPos < brot->pixelHeight; yPos++) {
-            brot->smooth_values[xPos][yPos] = 360.0 * brot_scale_value(brot->smooth_values[xPos][yPos], highest, lowest);
+            brot->progress(brot, brot->progress_data);
+
+            frame.coarse = frame.step;
+            brot_frame_fill(&frame);
         }
     }
 
-    // calculate colours
-    for (int xPos = 0; xPos < brot->pixelWidth; xPos++) {
-        for (int yPos = 0; yPos < brot->pixelHeight; yPos++) {
-            brot->canvas[xPos][yPos] = colour_from_hue(brot->smooth_values[xPos][yPos]);
+    // Calculate mandelbrot values
+    if (!atomic_load(&brot->cancel)) {
+        pool_run(brot->pool, brot_calculate_tiles, &frame);
+    }
+
+    free(frame.reuseX);
+    free(frame.reuseY);
+
+    brot_snapshot_release(brot, frame.previous);
+
+    // The planes are half written, so they can't be reused or kept in the history
+    if (atomic_load(&brot->cancel)) {
+        brot->current->computed = 0;
+        brot_frame_free(&frame);
+        return NULL;
+    }
+
+    brot_frame_colour(&frame);
+
+    brot_frame_free(&frame);
+
+    return brot;
+}
+
+// Thread task that only works out the highest and lowest values of pieces
+// whose values are already in the planes
+static void brot_stat_tiles(void *arg, int thread)
+{
+    Brot_Frame *frame = (Brot_Frame*) arg;
+    Mandelbrot brot = frame->brot;
+
+    int item, xStart, yStart, xEnd, yEnd;
+
+    while ( (item = pool_deque_pop(&frame->deques[thread])) >= 0 || (item = brot_work_steal(frame, thread)) >= 0 ) {
+
+        Brot_Work *work = &frame->work[item];
+
+        brot_tile_bounds(frame, work->tile, &xStart, &yStart, &xEnd, &yEnd);
+
+        for (int yPos = work->yStart; yPos < work->yEnd; yPos++) {
+            size_t offset = (size_t)yPos * brot->stride + xStart;
+
+            brot_span_stats(brot, brot->raw_values + offset, brot->fraction_values + offset, xEnd - xStart,
+                            &frame->highest[thread], &frame->lowest[thread]);
+            brot_span_histogram(frame, thread, brot->raw_values + offset, xEnd - xStart);
         }
+
+        work->next = frame->threadWork[thread];
+        frame->threadWork[thread] = item;
+    }
+}
+
+Mandelbrot brot_smooth_colour(Mandelbrot brot)
+{
+    Brot_Frame frame;
+
+    brot_frame_init(&frame, brot);
+
+    pool_run(brot->pool, brot_stat_tiles, &frame);
+
+    brot_frame_colour(&frame);
+
+    brot_frame_free(&frame);
+
+    return brot;
+}
+
+// Shared by the threads colouring the canvas again, a row at a time
+typedef struct brot_recolouring {
+    Mandelbrot brot;
+
+    atomic_int next_row;
+} Brot_Recolouring;
+
+static void brot_recolour_rows(void *arg, int thread)
+{
+    Brot_Recolouring *recolouring = (Brot_Recolouring*) arg;
+    Mandelbrot brot = recolouring->brot;
+
+    size_t offset;
+    int row;
+
+    (void)thread;
+
+    while ( (row = atomic_fetch_add(&recolouring->next_row, 1)) < brot->pixelHeight ) {
+        offset = (size_t)row * brot->stride;
+        brot_palette_span(brot->palette, brot->isa, brot->current->scale, brot->repeats, brot->raw_values + offset,
+                          brot->fraction_values + offset, brot->canvas + offset, brot->pixelWidth);
+    }
+}
+
+Mandelbrot brot_recolour(Mandelbrot brot)
+{
+    Brot_Recolouring recolouring;
+
+    if (!brot->current->computed) {
+        return NULL;
+    }
+
+    // Switching between histogram and linear colouring needs the values scanned again
+    if ((brot->current->scale->cdf != NULL) != (brot->colouring == BROT_COLOUR_HISTOGRAM)) {
+        return brot_smooth_colour(brot);
     }
 
+    recolouring.brot = brot;
+    atomic_init(&recolouring.next_row, 0);
+
+    pool_run(brot->pool, brot_recolour_rows, &recolouring);
+
+    brot->current->palette_version = brot->palette_version;
 
     return brot;
 }
 
+// Shared state for calculating a rectangle into someone else's buffers
+typedef struct brot_region {
+    Mandelbrot brot;
+
+    int xStart;
+    int yStart;
+    int xEnd;
+    int yEnd;
+
+    uint16_t *fraction;
+    int *raw;
+    int stride;
+
+    // The next row that hasn't been picked up by a thread yet
+    atomic_int next_row;
+} Brot_Region;
+
+static void brot_calculate_region_rows(void *arg, int thread)
+{
+    Brot_Region *region = (Brot_Region*) arg;
+    Mandelbrot brot = region->brot;
+
+    int width = region->xEnd - region->xStart;
+    int row;
+
+    (void)thread;
+
+    while ( (row = atomic_fetch_add(&region->next_row, 1)) < region->yEnd - region->yStart ) {
+        brot->kernel(brot, region->xStart, region->yStart + row, width, 1,
+                     region->fraction + (size_t)row * region->stride, region->raw + (size_t)row * region->stride);
+    }
+}
+
+void brot_compute_region(Mandelbrot brot, int xStart, int yStart, int xEnd, int yEnd,
+                         uint16_t *fraction, int *raw, int stride)
+{
+    Brot_Region region;
+
+    region.brot = brot;
+    region.xStart = xStart;
+    region.yStart = yStart;
+    region.xEnd = xEnd;
+    region.yEnd = yEnd;
+    region.fraction = fraction;
+    region.raw = raw;
+    region.stride = stride;
+
+    atomic_init(&region.next_row, 0);
+
+    pool_run(brot->pool, brot_calculate_region_rows, &region);
+}
+
 double brot_scale_value(double value, double high, double low)
 {
     return ( (value - low) / (high - low) );
 }
 
 double brot_calc_smooth_value(Mandelbrot brot, int xPos, int yPos)
+{
+    int iteration;
+
+    return brot_calc_escape(brot, xPos, yPos, &iteration);
+}
+
+double brot_calc_escape(Mandelbrot brot, int xPos, int yPos, int *iteration)
 {
     double xCoord = (double)brot->x1 + ((brot->x2 - brot->x1) * ((double)xPos / brot->pixelWidth));
 
@@ -138,14 +1317,27 @@ double brot_calc_smooth_value(Mandelbrot brot, int xPos, int yPos)
     // Pixels have origin at top left corner and y increases downwards
     double yCoord = (double)brot->y1 - ((brot->y1 - brot->y2) * ((double)yPos / brot->pixelHeight));
 
+    if (brot->interior_check && brot_in_main_regions(xCoord, yCoord)) {
+        *iteration = brot->repeats;
+        return -1.0;
+    }
+
     double x = 0;
     double y = 0;
 
     double temp = 0;
 
-    int iteration = 0;
+    int count = 0;
 
-    while ( ((x*x + y*y) < 4) && (iteration < brot->repeats) ) {
+    // Brent's cycle detection, the orbit is saved every time the
+    // iteration count reaches a power of two and if it comes back
+    // to the saved point the orbit is periodic and never escapes
+    double xSaved = 0;
+    double ySaved = 0;
+    int saveAt = 1;
+    double epsilon = brot_period_epsilon(brot);
+
+    while ( ((x*x + y*y) < 4) && (count < brot->repeats) ) {
 
         temp = x*x - y*y + xCoord;
 
@@ -153,9 +1345,81 @@ double brot_calc_smooth_value(Mandelbrot brot, int xPos, int yPos)
 
         x = temp;
 
-        iteration++;
+        count++;
+
+        if (brot->periodicity_check) {
+            if (fabs(x - xSaved) < epsilon && fabs(y - ySaved) < epsilon) {
+                *iteration = brot->repeats;
+                return -1.0;
+            }
+            if (count == saveAt) {
+                xSaved = x;
+                ySaved = y;
+                saveAt *= 2;
+            }
+        }
+    }
+
+    *iteration = count;
+
+    return brot_escape_value(brot, count, x, y);
+}
+
+double brot_pixel_spacing(Mandelbrot brot)
+{
+    return fabs(brot->spanX) / brot->pixelWidth;
+}
+
+const char *brot_precision_name(Brot_Precision precision)
+{
+    switch (precision) {
+        case BROT_PRECISION_FLOAT:
+            return "float";
+        case BROT_PRECISION_DOUBLE_DOUBLE:
+            return "double-double";
+        case BROT_PRECISION_PERTURB:
+            return "perturbation";
+        case BROT_PRECISION_DOUBLE:
+        default:
+            return "double";
     }
+}
 
+const char *brot_colouring_name(Brot_Colouring colouring)
+{
+    switch (colouring) {
+        case BROT_COLOUR_LINEAR:
+            return "linear";
+        case BROT_COLOUR_HISTOGRAM:
+        default:
+            return "histogram";
+    }
+}
+
+double brot_period_epsilon(Mandelbrot brot)
+{
+    // From the span rather than the corners, which can't tell deep pixels apart
+    return BROT_PERIOD_TOLERANCE * brot_pixel_spacing(brot);
+}
+
+int brot_in_main_regions(double x, double y)
+{
+    // Main cardioid
+    double xq = x - 0.25;
+    double q = xq*xq + y*y;
+
+    if (q * (q + xq) <= 0.25 * y*y) {
+        return 1;
+    }
+
+    // Period 2 bulb, the circle of radius 1/4 around -1
+    double xb = x + 1.0;
+
+    return (xb*xb + y*y) <= 0.0625;
+}
+
+double brot_escape_value(Mandelbrot brot, int iteration, double x, double y)
+{
     if (iteration == brot->repeats) {
         return -1.0;
     } else {
@@ -163,6 +1427,15 @@ double brot_calc_smooth_value(Mandelbrot brot, int xPos, int yPos)
     }
 }
 
+uint16_t brot_escape_fraction(Mandelbrot brot, int iteration, double x, double y)
+{
+    if (iteration == brot->repeats) {
+        return 0;
+    }
+
+    return brot_fraction_pack(iteration, brot_escape_value(brot, iteration, x, y));
+}
+
 
 uint32_t colour_from_hue(double value)
 {
@@ -217,13 +1490,28 @@ uint32_t colour_from_hue(double value)
 
 void brot_cleanup(Mandelbrot brot)
 {
-    for (int i = 0; i < brot->pixelWidth; i++) {
-        free(brot->canvas[i]);
+    while (brot->history_count > 0) {
+        brot_snapshot_release(brot, brot_history_pop(brot));
     }
 
-    free(brot->canvas);
+    if (brot->home != NULL) {
+        brot_snapshot_release(brot, brot->home);
+    }
 
-    free(brot);
-}
+    brot_snapshot_release(brot, brot->current);
 
+    // Releasing keeps one set of planes back as the spare
+    if (brot->spare != NULL) {
+        brot_snapshot_free(brot->spare);
+    }
+
+    brot_reference_cleanup(brot->reference);
+
+    brot_palette_free(brot->palette);
+
+    pool_cleanup(brot->pool);
 
+    free(brot->thread_stats);
+
+    free(brot);
+}
@@ -0,0 +1,336 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "mandelbrot.h"
+#include "mapped.h"
+#include "image.h"
+#include "lodepng.h"
+#include "palette.h"
+
+// A plane kept in a file rather than in memory, rows width long with no padding
+typedef struct brot_mapped_plane {
+    int fd;
+    size_t rowBytes;
+} Brot_Mapped_Plane;
+
+// Rows of a plane mapped into memory
+typedef struct brot_band {
+    void *mapping;
+    size_t length;
+
+    // Where the first row asked for starts, the mapping has
+    // to start on a page so it can be a little before this
+    void *rows;
+} Brot_Band;
+
+// Shared by the threads scanning a band for its highest and lowest values,
+// and for histogram colouring the number of pixels escaping at each iteration
+typedef struct brot_band_stats {
+    Mandelbrot brot;
+
+    uint16_t *fraction;
+    int *raw;
+    int width;
+    int rows;
+
+    atomic_int next_row;
+
+    double *highest;
+    double *lowest;
+
+    // Each thread's histogram, bins apart. NULL for linear colouring
+    uint64_t *histograms;
+    int bins;
+} Brot_Band_Stats;
+
+// Makes a file for the plane, removed straight away so it goes
+// when the process does. It's sparse until the rows are written
+static int brot_plane_open(Brot_Mapped_Plane *plane, const char *directory, const char *name,
+                           size_t rowBytes, int rows)
+{
+    char path[4096];
+
+    snprintf(path, sizeof(path), "%s/brot-%s-XXXXXX", directory, name);
+
+    plane->rowBytes = rowBytes;
+    plane->fd = mkstemp(path);
+
+    if (plane->fd < 0) {
+        printf("Couldn't create a file for the %s values in %s\n", name, directory);
+        return 0;
+    }
+
+    unlink(path);
+
+    if (ftruncate(plane->fd, (off_t)rowBytes * rows) != 0) {
+        printf("Couldn't make the file for the %s values big enough\n", name);
+        close(plane->fd);
+        plane->fd = -1;
+        return 0;
+    }
+
+    return 1;
+}
+
+static int brot_band_map(Brot_Mapped_Plane *plane, Brot_Band *band, int yStart, int rows)
+{
+    size_t page = sysconf(_SC_PAGESIZE);
+    size_t start = plane->rowBytes * yStart;
+    size_t offset = start - start % page;
+
+    band->length = plane->rowBytes * rows + (start - offset);
+    band->mapping = mmap(NULL, band->length, PROT_READ | PROT_WRITE, MAP_SHARED, plane->fd, offset);
+
+    if (band->mapping == MAP_FAILED) {
+        printf("Couldn't map rows %d to %d of the planes\n", yStart, yStart + rows);
+        return 0;
+    }
+
+    band->rows = (char*) band->mapping + (start - offset);
+
+    return 1;
+}
+
+static void brot_band_unmap(Brot_Band *band)
+{
+    munmap(band->mapping, band->length);
+}
+
+static void brot_band_stat_rows(void *arg, int thread)
+{
+    Brot_Band_Stats *stats = (Brot_Band_Stats*) arg;
+
+    int row;
+
+    while ((row = atomic_fetch_add(&stats->next_row, 1)) < stats->rows) {
+        size_t offset = (size_t)row * stats->width;
+
+        brot_span_stats(stats->brot, stats->raw + offset, stats->fraction + offset, stats->width,
+                        &stats->highest[thread], &stats->lowest[thread]);
+
+        if (stats->histograms != NULL) {
+            brot_histogram_add(stats->histograms + (size_t)thread * stats->bins, stats->brot->repeats,
+                               stats->raw + offset, stats->width);
+        }
+    }
+}
+
+// How many rows to a band, so a band of both planes is about BROT_BAND_BYTES
+static int brot_band_rows(Mandelbrot brot)
+{
+    int rows = BROT_BAND_BYTES / ((size_t)brot->pixelWidth * (sizeof(uint16_t) + sizeof(int)));
+
+    return rows > 0 ? rows : 1;
+}
+
+// Calculates every band, only keeping one mapped at a time
+static int brot_mapped_calculate(Mandelbrot brot, Brot_Mapped_Plane *fractionPlane, Brot_Mapped_Plane *rawPlane)
+{
+    int width = brot->pixelWidth;
+    int height = brot->pixelHeight;
+    int bandRows = brot_band_rows(brot);
+
+    Brot_Band fraction, raw;
+
+    brot_select_kernel(brot);
+
+    for (int yStart = 0; yStart < height; yStart += bandRows) {
+
+        int rows = yStart + bandRows < height ? bandRows : height - yStart;
+
+        if (!brot_band_map(fractionPlane, &fraction, yStart, rows)) {
+            return 0;
+        }
+        if (!brot_band_map(rawPlane, &raw, yStart, rows)) {
+            brot_band_unmap(&fraction);
+            return 0;
+        }
+
+        brot_compute_region(brot, 0, yStart, width, yStart + rows, (uint16_t*) fraction.rows, (int*) raw.rows, width);
+
+        brot_band_unmap(&fraction);
+        brot_band_unmap(&raw);
+    }
+
+    return 1;
+}
+
+// The colours are scaled by the values of the whole frame, which takes
+// another pass once they're all calculated
+static int brot_mapped_stats(Mandelbrot brot, Brot_Mapped_Plane *fractionPlane, Brot_Mapped_Plane *rawPlane,
+                             Brot_Colour_Scale *scale)
+{
+    int width = brot->pixelWidth;
+    int height = brot->pixelHeight;
+    int bandRows = brot_band_rows(brot);
+    int threads = brot->pool->count > 0 ? brot->pool->count : 1;
+
+    Brot_Band fraction, raw;
+    Brot_Band_Stats stats;
+
+    int mapped = 1;
+    double highest = 0.0;
+    double lowest = 1000;
+
+    stats.brot = brot;
+    stats.width = width;
+    stats.highest = (double*) malloc(sizeof(double) * threads);
+    stats.lowest = (double*) malloc(sizeof(double) * threads);
+
+    stats.histograms = NULL;
+    stats.bins = brot_histogram_bins(brot->repeats);
+
+    if (brot->colouring == BROT_COLOUR_HISTOGRAM) {
+        stats.histograms = (uint64_t*) calloc((size_t)stats.bins * threads, sizeof(uint64_t));
+    }
+
+    for (int thread = 0; thread < threads; thread++) {
+        stats.highest[thread] = 0.0;
+        stats.lowest[thread] = 1000;
+    }
+
+    for (int yStart = 0; yStart < height && mapped; yStart += bandRows) {
+
+        stats.rows = yStart + bandRows < height ? bandRows : height - yStart;
+
+        if (!(mapped = brot_band_map(fractionPlane, &fraction, yStart, stats.rows))) {
+            break;
+        }
+        if (!(mapped = brot_band_map(rawPlane, &raw, yStart, stats.rows))) {
+            brot_band_unmap(&fraction);
+            break;
+        }
+
+        stats.fraction = (uint16_t*) fraction.rows;
+        stats.raw = (int*) raw.rows;
+        atomic_init(&stats.next_row, 0);
+
+        pool_run(brot->pool, brot_band_stat_rows, &stats);
+
+        brot_band_unmap(&fraction);
+        brot_band_unmap(&raw);
+    }
+
+    for (int thread = 0; thread < threads; thread++) {
+        if (stats.highest[thread] > highest) {
+            highest = stats.highest[thread];
+        }
+        if (stats.lowest[thread] < lowest) {
+            lowest = stats.lowest[thread];
+        }
+    }
+
+    if (stats.histograms == NULL) {
+        brot_colour_scale_linear(scale, highest, lowest);
+    } else {
+        // Summed into the first thread's histogram
+        for (int thread = 1; thread < threads; thread++) {
+            uint64_t *histogram = stats.histograms + (size_t)thread * stats.bins;
+            for (int bin = 0; bin < stats.bins; bin++) {
+                stats.histograms[bin] += histogram[bin];
+            }
+        }
+
+        brot_colour_scale_histogram(scale, stats.histograms, brot->repeats);
+    }
+
+    free(stats.highest);
+    free(stats.lowest);
+    free(stats.histograms);
+
+    return mapped;
+}
+
+// Colours the rows in order and hands them to the PNG as they're done
+static unsigned brot_mapped_encode(Mandelbrot brot, Brot_Mapped_Plane *fractionPlane, Brot_Mapped_Plane *rawPlane,
+                                   const Brot_Colour_Scale *scale, char *output_file)
+{
+    int width = brot->pixelWidth;
+    int height = brot->pixelHeight;
+    int bandRows = brot_band_rows(brot);
+
+    Brot_Band fraction, raw;
+    LodePNGStream *stream;
+
+    uint32_t *colours = (uint32_t*) malloc(sizeof(uint32_t) * width);
+    unsigned char *scanline = (unsigned char*) malloc((size_t)width * 3);
+
+    unsigned err = lodepng_stream_open(&stream, output_file, width, height);
+
+    for (int yStart = 0; yStart < height && !err; yStart += bandRows) {
+
+        int rows = yStart + bandRows < height ? bandRows : height - yStart;
+
+        if (!brot_band_map(fractionPlane, &fraction, yStart, rows)) {
+            err = 1;
+            break;
+        }
+        if (!brot_band_map(rawPlane, &raw, yStart, rows)) {
+            brot_band_unmap(&fraction);
+            err = 1;
+            break;
+        }
+
+        for (int row = 0; row < rows && !err; row++) {
+            size_t offset = (size_t)row * width;
+
+            brot_palette_span(brot->palette, brot->isa, scale, brot->repeats, (int*) raw.rows + offset,
+                              (uint16_t*) fraction.rows + offset, colours, width);
+
+            render_png_scanline(colours, scanline, width);
+            err = lodepng_stream_push(stream, scanline);
+        }
+
+        brot_band_unmap(&fraction);
+        brot_band_unmap(&raw);
+    }
+
+    if (stream != NULL) {
+        unsigned closeErr = lodepng_stream_close(stream);
+        if (!err) {
+            err = closeErr;
+        }
+    }
+
+    if (err > 1) {
+        printf("error %u: %s\n", err, lodepng_error_text(err));
+    }
+
+    free(colours);
+    free(scanline);
+
+    return err;
+}
+
+unsigned brot_render_mapped(Mandelbrot brot, const char *directory, char *output_file)
+{
+    Brot_Mapped_Plane fractionPlane = {-1, 0};
+    Brot_Mapped_Plane rawPlane = {-1, 0};
+
+    Brot_Colour_Scale scale = {0.0, 0.0, NULL, 0, 0};
+
+    unsigned err = 1;
+
+    if (brot_plane_open(&fractionPlane, directory, "fraction", sizeof(uint16_t) * brot->pixelWidth, brot->pixelHeight) &&
+        brot_plane_open(&rawPlane, directory, "raw", sizeof(int) * brot->pixelWidth, brot->pixelHeight) &&
+        brot_mapped_calculate(brot, &fractionPlane, &rawPlane) &&
+        brot_mapped_stats(brot, &fractionPlane, &rawPlane, &scale)) {
+
+        err = brot_mapped_encode(brot, &fractionPlane, &rawPlane, &scale, output_file);
+    }
+
+    brot_colour_scale_free(&scale);
+
+    if (fractionPlane.fd >= 0) {
+        close(fractionPlane.fd);
+    }
+    if (rawPlane.fd >= 0) {
+        close(rawPlane.fd);
+    }
+
+    return err;
+}
@@ -0,0 +1,415 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+#include "mandelbrot.h"
+#include "palette.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define BROT_X86
+#endif
+
+// A built in palette, either worked out by a function or blended from stops
+typedef struct brot_palette_builtin {
+    const char *name;
+    Brot_Palette_Colour colour;
+    const uint32_t *stops;
+    int count;
+    int cyclic;
+} Brot_Palette_Builtin;
+
+static uint32_t brot_palette_hue(double position)
+{
+    return colour_from_hue(360.0 * position);
+}
+
+static const uint32_t brot_classic_stops[] = {0x000764, 0x206BCB, 0xEDFFFF, 0xFFAA00, 0x000200};
+static const uint32_t brot_fire_stops[] = {0x000000, 0x800000, 0xFF4000, 0xFFC000, 0xFFFFFF};
+static const uint32_t brot_ice_stops[] = {0x000010, 0x0040A0, 0x80E0FF, 0xFFFFFF};
+
+static const Brot_Palette_Builtin brot_palettes[] = {
+    {"hue", brot_palette_hue, NULL, 0, 1},
+    {"classic", NULL, brot_classic_stops, 5, 1},
+    {"fire", NULL, brot_fire_stops, 5, 0},
+    {"ice", NULL, brot_ice_stops, 4, 0},
+};
+
+#define BROT_PALETTE_BUILTINS (int)(sizeof(brot_palettes) / sizeof(brot_palettes[0]))
+
+static Brot_Palette *brot_palette_alloc(const char *name, int cyclic)
+{
+    Brot_Palette *palette = (Brot_Palette*) malloc(sizeof(Brot_Palette));
+
+    palette->name = name;
+    palette->cyclic = cyclic;
+
+    return palette;
+}
+
+// Fills in the entry for a position of exactly 1 once the rest are baked
+static void brot_palette_finish(Brot_Palette *palette)
+{
+    palette->colours[BROT_PALETTE_SIZE] = palette->colours[palette->cyclic ? 0 : BROT_PALETTE_SIZE - 1];
+}
+
+Brot_Palette *brot_palette_bake(const char *name, Brot_Palette_Colour colour, int cyclic)
+{
+    Brot_Palette *palette = brot_palette_alloc(name, cyclic);
+
+    for (int i = 0; i < BROT_PALETTE_SIZE; i++) {
+        palette->colours[i] = colour((i + 0.5) / BROT_PALETTE_SIZE);
+    }
+
+    brot_palette_finish(palette);
+
+    return palette;
+}
+
+static uint32_t brot_blend_channel(uint32_t a, uint32_t b, int shift, double f)
+{
+    double from = (a >> shift) & 255;
+    double to = (b >> shift) & 255;
+
+    return (uint32_t)(from + (to - from) * f + 0.5) << shift;
+}
+
+Brot_Palette *brot_palette_gradient(const char *name, const uint32_t *stops, int count, int cyclic)
+{
+    Brot_Palette *palette = brot_palette_alloc(name, cyclic);
+
+    // A cyclic palette has one more blend, from the last stop back to the first
+    int blends = cyclic ? count : count - 1;
+
+    for (int i = 0; i < BROT_PALETTE_SIZE; i++) {
+
+        if (blends < 1) {
+            palette->colours[i] = stops[0];
+            continue;
+        }
+
+        double along = (i + 0.5) / BROT_PALETTE_SIZE * blends;
+        int stop = (int)along;
+        double f = along - stop;
+
+        uint32_t a = stops[stop];
+        uint32_t b = stops[(stop + 1) % count];
+
+        palette->colours[i] = brot_blend_channel(a, b, 16, f) |
+                              brot_blend_channel(a, b, 8, f) |
+                              brot_blend_channel(a, b, 0, f);
+    }
+
+    brot_palette_finish(palette);
+
+    return palette;
+}
+
+Brot_Palette *brot_palette_named(const char *name)
+{
+    for (int i = 0; i < BROT_PALETTE_BUILTINS; i++) {
+
+        const Brot_Palette_Builtin *builtin = &brot_palettes[i];
+
+        if (strcmp(builtin->name, name) != 0) {
+            continue;
+        }
+
+        if (builtin->colour != NULL) {
+            return brot_palette_bake(builtin->name, builtin->colour, builtin->cyclic);
+        }
+
+        return brot_palette_gradient(builtin->name, builtin->stops, builtin->count, builtin->cyclic);
+    }
+
+    return NULL;
+}
+
+const char *brot_palette_name(int index)
+{
+    if (index < 0 || index >= BROT_PALETTE_BUILTINS) {
+        return NULL;
+    }
+
+    return brot_palettes[index].name;
+}
+
+void brot_palette_cycle(Brot_Palette *palette, int steps)
+{
+    uint32_t cycled[BROT_PALETTE_SIZE];
+
+    int shift = ((steps % BROT_PALETTE_SIZE) + BROT_PALETTE_SIZE) % BROT_PALETTE_SIZE;
+
+    for (int i = 0; i < BROT_PALETTE_SIZE; i++) {
+        cycled[i] = palette->colours[(i + shift) % BROT_PALETTE_SIZE];
+    }
+
+    memcpy(palette->colours, cycled, sizeof(cycled));
+
+    brot_palette_finish(palette);
+}
+
+void brot_palette_free(Brot_Palette *palette)
+{
+    free(palette);
+}
+
+// Where a value falls in the table is worked out the same way in the
+// scalar and vector versions so they always pick the same entry
+static inline uint32_t brot_palette_lookup(const Brot_Palette *palette, double value, double lowest, double scale)
+{
+    double position = (value - lowest) * scale;
+
+    // Also catches the NaN of a frame where every pixel is the same
+    if (!(position >= 0)) {
+        return 0;
+    }
+
+    if (position > BROT_PALETTE_SIZE) {
+        position = BROT_PALETTE_SIZE;
+    }
+
+    return palette->colours[(int)position];
+}
+
+int brot_histogram_bins(int repeats)
+{
+    return repeats < BROT_HISTOGRAM_BINS ? repeats : BROT_HISTOGRAM_BINS;
+}
+
+void brot_histogram_add(uint64_t *counts, int repeats, const int *raw, int count)
+{
+    int bins = brot_histogram_bins(repeats);
+
+    if (bins == repeats) {
+        for (int i = 0; i < count; i++) {
+            if (raw[i] < repeats) {
+                counts[raw[i]]++;
+            }
+        }
+        return;
+    }
+
+    for (int i = 0; i < count; i++) {
+        if (raw[i] < repeats) {
+            counts[(int)((int64_t)raw[i] * bins / repeats)]++;
+        }
+    }
+}
+
+void brot_colour_scale_linear(Brot_Colour_Scale *scale, double highest, double lowest)
+{
+    scale->highest = highest;
+    scale->lowest = lowest;
+    scale->cdf = NULL;
+    scale->bins = 0;
+    scale->repeats = 0;
+}
+
+void brot_colour_scale_histogram(Brot_Colour_Scale *scale, const uint64_t *counts, int repeats)
+{
+    int bins = brot_histogram_bins(repeats);
+
+    uint64_t total = 0;
+    uint64_t below = 0;
+
+    for (int bin = 0; bin < bins; bin++) {
+        total += counts[bin];
+    }
+
+    scale->highest = 0;
+    scale->lowest = 0;
+    scale->bins = bins;
+    scale->repeats = repeats;
+    scale->cdf = (double*) malloc(sizeof(double) * (bins + 1));
+
+    for (int bin = 0; bin <= bins; bin++) {
+        scale->cdf[bin] = total > 0 ? (double)BROT_PALETTE_SIZE * below / total : 0;
+        if (bin < bins) {
+            below += counts[bin];
+        }
+    }
+}
+
+void brot_colour_scale_free(Brot_Colour_Scale *scale)
+{
+    free(scale->cdf);
+    scale->cdf = NULL;
+}
+
+// Finds how far through its bin a value is and blends between where that bin
+// and the next start, so the colours don't band at each iteration
+static inline uint32_t brot_palette_lookup_histogram(const Brot_Palette *palette, const Brot_Colour_Scale *scale,
+                                                     double value, double binScale)
+{
+    if (!(value > 0)) {
+        return 0;
+    }
+
+    double along = value * binScale;
+    int bin = (int)along;
+
+    if (bin >= scale->bins) {
+        return palette->colours[BROT_PALETTE_SIZE];
+    }
+
+    double start = scale->cdf[bin];
+
+    return palette->colours[(int)(start + (along - bin) * (scale->cdf[bin + 1] - start))];
+}
+
+uint32_t brot_palette_colour(const Brot_Palette *palette, const Brot_Colour_Scale *scale, double value)
+{
+    if (scale->cdf != NULL) {
+        return brot_palette_lookup_histogram(palette, scale, value, (double)scale->bins / scale->repeats);
+    }
+
+    return brot_palette_lookup(palette, value, scale->lowest, BROT_PALETTE_SIZE / (scale->highest - scale->lowest));
+}
+
+#ifdef BROT_X86
+
+// Decodes four pixels the same way as brot_fraction_value, the sums are all exact
+__attribute__((target("avx2")))
+static inline __m256d brot_palette_values_avx2(__m128i iterations, const uint16_t *fraction)
+{
+    __m128i fractions = _mm_cvtepu16_epi32(_mm_loadl_epi64((const __m128i*) fraction));
+
+    __m256d value = _mm256_add_pd(_mm256_cvtepi32_pd(iterations),
+                                  _mm256_mul_pd(_mm256_cvtepi32_pd(fractions), _mm256_set1_pd(1.0 / BROT_FRACTION_ONE)));
+
+    return _mm256_sub_pd(value, _mm256_set1_pd(BROT_FRACTION_OFFSET));
+}
+
+// Four pixels at a time, the lanes under the lowest value or in the set
+// are masked out of the gather so they're left black
+__attribute__((target("avx2")))
+static int brot_palette_span_avx2(const Brot_Palette *palette, const int *raw, const uint16_t *fraction,
+                                  uint32_t *colours, int count, int repeats, double lowest, double scale)
+{
+    const __m256d vLowest = _mm256_set1_pd(lowest);
+    const __m256d vScale = _mm256_set1_pd(scale);
+    const __m256d vEnd = _mm256_set1_pd(BROT_PALETTE_SIZE);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m128i vRepeats = _mm_set1_epi32(repeats);
+
+    // Takes the low half of each 64 bit lane mask for the 32 bit gather
+    const __m256i lowHalves = _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0);
+
+    int i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        __m128i iterations = _mm_loadu_si128((const __m128i*)(raw + i));
+        __m256d value = brot_palette_values_avx2(iterations, fraction + i);
+
+        __m256d position = _mm256_mul_pd(_mm256_sub_pd(value, vLowest), vScale);
+
+        __m256d inside = _mm256_cmp_pd(position, zero, _CMP_GE_OQ);
+
+        // Anything masked off is zeroed so it still converts to a valid index
+        position = _mm256_and_pd(_mm256_min_pd(position, vEnd), inside);
+
+        __m128i index = _mm256_cvttpd_epi32(position);
+        __m128i mask = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(_mm256_castpd_si256(inside), lowHalves));
+
+        // Points in the set are masked off too
+        mask = _mm_and_si128(mask, _mm_cmplt_epi32(iterations, vRepeats));
+
+        __m128i colour = _mm_mask_i32gather_epi32(_mm_setzero_si128(), (const int*) palette->colours, index, mask, 4);
+
+        _mm_storeu_si128((__m128i*)(colours + i), colour);
+    }
+
+    return i;
+}
+
+// The histogram lookup four pixels at a time, gathering where each pixel's
+// bin and the next start and then the colour between them
+__attribute__((target("avx2")))
+static int brot_palette_span_histogram_avx2(const Brot_Palette *palette, const Brot_Colour_Scale *scale,
+                                            const int *raw, const uint16_t *fraction, uint32_t *colours,
+                                            int count, int repeats, double binScale)
+{
+    const __m256d vBinScale = _mm256_set1_pd(binScale);
+    const __m256d zero = _mm256_setzero_pd();
+    const __m128i vRepeats = _mm_set1_epi32(repeats);
+    const __m128i lastBin = _mm_set1_epi32(scale->bins - 1);
+    const __m128i vEnd = _mm_set1_epi32(BROT_PALETTE_SIZE);
+
+    const __m256i lowHalves = _mm256_setr_epi32(0, 2, 4, 6, 0, 0, 0, 0);
+
+    int i;
+
+    for (i = 0; i + 4 <= count; i += 4) {
+        __m128i iterations = _mm_loadu_si128((const __m128i*)(raw + i));
+        __m256d value = brot_palette_values_avx2(iterations, fraction + i);
+
+        __m256d along = _mm256_mul_pd(value, vBinScale);
+        __m128i bin = _mm256_cvttpd_epi32(along);
+
+        // Past the last bin is the end of the palette. The bin is clamped so
+        // the gathers stay in the table, whatever the lane ends up as
+        __m128i beyond = _mm_cmpgt_epi32(bin, lastBin);
+        bin = _mm_min_epi32(_mm_max_epi32(bin, _mm_setzero_si128()), lastBin);
+
+        __m256d start = _mm256_i32gather_pd(scale->cdf, bin, 8);
+        __m256d next = _mm256_i32gather_pd(scale->cdf + 1, bin, 8);
+
+        __m256d position = _mm256_add_pd(start, _mm256_mul_pd(_mm256_sub_pd(along, _mm256_cvtepi32_pd(bin)),
+                                                              _mm256_sub_pd(next, start)));
+
+        __m128i index = _mm_blendv_epi8(_mm256_cvttpd_epi32(position), vEnd, beyond);
+
+        __m256d positive = _mm256_cmp_pd(value, zero, _CMP_GT_OQ);
+        __m128i mask = _mm256_castsi256_si128(_mm256_permutevar8x32_epi32(_mm256_castpd_si256(positive), lowHalves));
+
+        mask = _mm_and_si128(mask, _mm_cmplt_epi32(iterations, vRepeats));
+
+        __m128i colour = _mm_mask_i32gather_epi32(_mm_setzero_si128(), (const int*) palette->colours, index, mask, 4);
+
+        _mm_storeu_si128((__m128i*)(colours + i), colour);
+    }
+
+    return i;
+}
+
+#endif
+
+void brot_palette_span(const Brot_Palette *palette, Brot_ISA isa, const Brot_Colour_Scale *scale, int repeats,
+                       const int *raw, const uint16_t *fraction, uint32_t *colours, int count)
+{
+    int done = 0;
+
+    if (scale->cdf != NULL) {
+        double binScale = (double)scale->bins / scale->repeats;
+
+#ifdef BROT_X86
+        if (isa != BROT_ISA_SCALAR) {
+            done = brot_palette_span_histogram_avx2(palette, scale, raw, fraction, colours, count, repeats, binScale);
+        }
+#endif
+
+        for (int i = done; i < count; i++) {
+            colours[i] = brot_palette_lookup_histogram(palette, scale, brot_fraction_value(repeats, raw[i], fraction[i]),
+                                                       binScale);
+        }
+        return;
+    }
+
+    double lowest = scale->lowest;
+    double factor = BROT_PALETTE_SIZE / (scale->highest - scale->lowest);
+
+#ifdef BROT_X86
+    if (isa != BROT_ISA_SCALAR) {
+        done = brot_palette_span_avx2(palette, raw, fraction, colours, count, repeats, lowest, factor);
+    }
+#endif
+
+    // Points in the set are black whichever way the scale runs, the same as the gathers.
+    // A frame with nothing outside the set has a negative factor
+    for (int i = done; i < count; i++) {
+        colours[i] = raw[i] < repeats ?
+                     brot_palette_lookup(palette, brot_fraction_value(repeats, raw[i], fraction[i]), lowest, factor) : 0;
+    }
+}
@@ -0,0 +1,306 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include <math.h>
+
+#include "mandelbrot.h"
+#include "perturb.h"
+#include "fixed.h"
+
+static void brot_bla_free(Brot_Reference *reference)
+{
+    for (int level = 0; level < reference->blaLevels; level++) {
+        free(reference->bla[level]);
+    }
+    reference->blaLevels = 0;
+}
+
+// Builds the approximation table for pixels up to offset away from the reference
+// Level 0 is a single iteration, dz -> 2 Z dz + dc, which holds while
+// dz^2 is tiny next to 2 Z dz. Each level above merges pairs from the one below
+static void brot_bla_build(Brot_Reference *reference, double offset)
+{
+    Brot_Bla *lower, *upper, *x, *y;
+    double epsilon = BROT_BLA_EPSILON;
+    int count = reference->length - 1;
+
+    brot_bla_free(reference);
+    reference->blaOffset = offset;
+
+    if (count <= 0) {
+        return;
+    }
+
+    lower = (Brot_Bla*) malloc(sizeof(Brot_Bla) * count);
+
+    for (int j = 0; j < count; j++) {
+        double zx = reference->x[j + 1];
+        double zy = reference->y[j + 1];
+
+        lower[j].ax = 2 * zx;
+        lower[j].ay = 2 * zy;
+        lower[j].bx = 1;
+        lower[j].by = 0;
+        lower[j].radius = epsilon * sqrt(zx*zx + zy*zy);
+        lower[j].skip = 1;
+    }
+
+    reference->bla[0] = lower;
+    reference->blaCount[0] = count;
+    reference->blaLevels = 1;
+
+    while (count > 1 && reference->blaLevels < BROT_BLA_MAX_LEVELS) {
+        count = (count + 1) / 2;
+        upper = (Brot_Bla*) malloc(sizeof(Brot_Bla) * count);
+
+        for (int j = 0; j < count; j++) {
+            x = &lower[2*j];
+
+            // An odd one out at the end just moves up a level
+            if (2*j + 1 >= reference->blaCount[reference->blaLevels - 1]) {
+                upper[j] = *x;
+                continue;
+            }
+
+            y = &lower[2*j + 1];
+
+            // Doing x then y, dz -> Ay (Ax dz + Bx dc) + By dc
+            upper[j].ax = y->ax * x->ax - y->ay * x->ay;
+            upper[j].ay = y->ax * x->ay + y->ay * x->ax;
+            upper[j].bx = y->ax * x->bx - y->ay * x->by + y->bx;
+            upper[j].by = y->ax * x->by + y->ay * x->bx + y->by;
+            upper[j].skip = x->skip + y->skip;
+
+            // y has to hold for wherever x can take the offset to
+            double ax = sqrt(x->ax * x->ax + x->ay * x->ay);
+            double bx = sqrt(x->bx * x->bx + x->by * x->by);
+            double radius = ax > 0 ? (y->radius - bx * offset) / ax : 0;
+
+            upper[j].radius = fmin(x->radius, fmax(0, radius));
+        }
+
+        reference->bla[reference->blaLevels] = upper;
+        reference->blaCount[reference->blaLevels] = count;
+        reference->blaLevels++;
+
+        lower = upper;
+    }
+}
+
+// Finds the longest skip starting at iteration m that the offset is small enough for
+static Brot_Bla *brot_bla_lookup(Brot_Reference *reference, int m, double dzx, double dzy, int left)
+{
+    double size = dzx*dzx + dzy*dzy;
+    int j = m - 1;
+
+    if (m < 1 || j >= reference->blaCount[0]) {
+        return NULL;
+    }
+
+    // Every level's radius is at most the one below it,
+    // so most of the time this is as far as it gets
+    Brot_Bla *bla = &reference->bla[0][j];
+
+    if (size >= bla->radius * bla->radius) {
+        return NULL;
+    }
+
+    // Climb the levels whose blocks start at m while the offset still fits
+    for (int level = 1; level < reference->blaLevels && (j & ((1 << level) - 1)) == 0; level++) {
+        Brot_Bla *next = &reference->bla[level][j >> level];
+
+        if (next->skip > left || size >= next->radius * next->radius) {
+            break;
+        }
+        bla = next;
+    }
+
+    return bla->skip <= left ? bla : NULL;
+}
+
+void brot_reference_update(Mandelbrot brot)
+{
+    Brot_Reference *reference = brot->reference;
+
+    if (reference == NULL) {
+        reference = (Brot_Reference*) malloc(sizeof(Brot_Reference));
+        reference->x = NULL;
+        reference->y = NULL;
+        reference->valid = 0;
+        reference->blaLevels = 0;
+        brot->reference = reference;
+    }
+
+    // Every pixel is within half the diagonal of the centre
+    double offset = sqrt(brot->spanX * brot->spanX + brot->spanY * brot->spanY) / 2;
+
+    if (reference->valid &&
+        reference->repeats == brot->repeats &&
+        brot_fixed_equal(&reference->cx, &brot->centerX) &&
+        brot_fixed_equal(&reference->cy, &brot->centerY)) {
+
+        if (reference->blaOffset != offset) {
+            brot_bla_build(reference, offset);
+        }
+        return;
+    }
+
+    free(reference->x);
+    free(reference->y);
+
+    reference->x = (double*) malloc(sizeof(double) * (brot->repeats + 1));
+    reference->y = (double*) malloc(sizeof(double) * (brot->repeats + 1));
+
+    reference->cx = brot->centerX;
+    reference->cy = brot->centerY;
+    reference->repeats = brot->repeats;
+
+    // The centre is already held at the precision the view needs
+    int limbs = brot->centerX.limbs;
+
+    Brot_Fixed zx, zy, xx, yy, xy;
+
+    brot_fixed_from_double(&zx, 0, limbs);
+    brot_fixed_from_double(&zy, 0, limbs);
+
+    reference->x[0] = 0;
+    reference->y[0] = 0;
+    reference->length = brot->repeats;
+
+    double x, y;
+
+    for (int n = 0; n < brot->repeats; n++) {
+
+        brot_fixed_mul(&xx, &zx, &zx);
+        brot_fixed_mul(&yy, &zy, &zy);
+        brot_fixed_mul(&xy, &zx, &zy);
+
+        brot_fixed_sub(&zx, &xx, &yy);
+        brot_fixed_add(&zx, &zx, &reference->cx);
+
+        brot_fixed_add(&zy, &xy, &xy);
+        brot_fixed_add(&zy, &zy, &reference->cy);
+
+        x = brot_fixed_to_double(&zx);
+        y = brot_fixed_to_double(&zy);
+
+        reference->x[n + 1] = x;
+        reference->y[n + 1] = y;
+
+        if (x*x + y*y >= 4) {
+            reference->length = n + 1;
+            break;
+        }
+    }
+
+    reference->valid = 1;
+
+    brot_bla_build(reference, offset);
+}
+
+void brot_reference_cleanup(Brot_Reference *reference)
+{
+    if (reference == NULL) {
+        return;
+    }
+
+    brot_bla_free(reference);
+
+    free(reference->x);
+    free(reference->y);
+    free(reference);
+}
+
+// Iterates one pixel, dcx and dcy being its offset from the reference point
+// Gives back the iteration count and leaves the final point in zxOut and zyOut
+static int brot_perturb_point(Brot_Reference *reference, int repeats, double dcx, double dcy,
+                              double *zxOut, double *zyOut, int *rebased)
+{
+    double dzx = 0;
+    double dzy = 0;
+
+    double zx = 0;
+    double zy = 0;
+
+    double ax, ay, temp;
+    Brot_Bla *bla;
+
+    int m = 0;
+    int n = 0;
+
+    while (n < repeats) {
+
+        // The pixel's actual orbit point
+        zx = reference->x[m] + dzx;
+        zy = reference->y[m] + dzy;
+
+        if (zx*zx + zy*zy >= 4) {
+            break;
+        }
+
+        // Glitch, the orbit is nearer zero than the offset is small,
+        // so start again from the beginning of the reference with the
+        // full point as the offset. Z_0 is zero so nothing is lost
+        if (zx*zx + zy*zy < dzx*dzx + dzy*dzy || m == reference->length) {
+            dzx = zx;
+            dzy = zy;
+            m = 0;
+            *rebased = 1;
+        }
+
+        // Skip ahead while the offset is small enough for the table
+        bla = brot_bla_lookup(reference, m, dzx, dzy, repeats - n);
+        if (bla != NULL) {
+            temp = bla->ax * dzx - bla->ay * dzy + bla->bx * dcx - bla->by * dcy;
+            dzy = bla->ax * dzy + bla->ay * dzx + bla->bx * dcy + bla->by * dcx;
+            dzx = temp;
+
+            m += bla->skip;
+            n += bla->skip;
+            continue;
+        }
+
+        // dz' = (2Z + dz) dz + dc
+        ax = 2*reference->x[m] + dzx;
+        ay = 2*reference->y[m] + dzy;
+
+        temp = ax*dzx - ay*dzy + dcx;
+        dzy = ax*dzy + ay*dzx + dcy;
+        dzx = temp;
+
+        m++;
+        n++;
+    }
+
+    *zxOut = zx;
+    *zyOut = zy;
+
+    return n;
+}
+
+void brot_kernel_perturb(Mandelbrot brot, int xPos, int yPos, int count, int step, uint16_t *fraction, int *raw)
+{
+    Brot_Reference *reference = brot->reference;
+
+    // Same sign conventions as x1 to y2, y goes down the screen
+    double dcy = -brot->spanY * ((double)yPos / brot->pixelHeight - 0.5);
+    double dcx, zx, zy;
+
+    long glitches = 0;
+    int rebased;
+
+    for (int i = 0; i < count; i++) {
+        dcx = brot->spanX * ((double)(xPos + i * step) / brot->pixelWidth - 0.5);
+
+        rebased = 0;
+        raw[i] = brot_perturb_point(reference, brot->repeats, dcx, dcy, &zx, &zy, &rebased);
+        fraction[i] = brot_escape_fraction(brot, raw[i], zx, zy);
+
+        glitches += rebased;
+    }
+
+    if (glitches > 0) {
+        atomic_fetch_add(&brot->glitches, glitches);
+    }
+}
@@ -0,0 +1,215 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "pool.h"
+
+typedef struct pool_worker {
+    Pool pool;
+    int index;
+} Pool_Worker;
+
+static void *pool_thread(void *data)
+{
+    Pool_Worker *worker = (Pool_Worker*) data;
+    Pool pool = worker->pool;
+    int index = worker->index;
+
+    unsigned long seen = 0;
+
+    free(worker);
+
+    pthread_mutex_lock(&pool->lock);
+
+    while (1) {
+        while (!pool->shutdown && pool->generation == seen) {
+            pthread_cond_wait(&pool->start, &pool->lock);
+        }
+
+        if (pool->shutdown) {
+            break;
+        }
+
+        seen = pool->generation;
+
+        Pool_Task task = pool->task;
+        void *arg = pool->arg;
+
+        pthread_mutex_unlock(&pool->lock);
+
+        task(arg, index);
+
+        pthread_mutex_lock(&pool->lock);
+
+        pool->pending--;
+        if (pool->pending == 0) {
+            pthread_cond_signal(&pool->done);
+        }
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+
+    return NULL;
+}
+
+Pool pool_create(int count)
+{
+    Pool pool = (Pool) malloc(sizeof(Pool_Data));
+
+    if (count <= 0) {
+        count = (int) sysconf(_SC_NPROCESSORS_ONLN);
+    }
+    if (count <= 0) {
+        count = 1;
+    }
+
+    pool->threads = (pthread_t*) malloc(sizeof(pthread_t) * count);
+    pool->count = 0;
+
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->start, NULL);
+    pthread_cond_init(&pool->done, NULL);
+
+    pool->task = NULL;
+    pool->arg = NULL;
+
+    pool->generation = 0;
+    pool->pending = 0;
+    pool->shutdown = 0;
+
+    for (int i = 0; i < count; i++) {
+        Pool_Worker *worker = (Pool_Worker*) malloc(sizeof(Pool_Worker));
+        worker->pool = pool;
+        worker->index = i;
+
+        if (pthread_create(&pool->threads[i], NULL, pool_thread, worker) != 0) {
+            free(worker);
+            break;
+        }
+        pool->count++;
+    }
+
+    return pool;
+}
+
+void pool_run(Pool pool, Pool_Task task, void *arg)
+{
+    // If no threads could be started just do the work here
+    if (pool->count == 0) {
+        task(arg, 0);
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+
+    pool->task = task;
+    pool->arg = arg;
+    pool->pending = pool->count;
+    pool->generation++;
+
+    pthread_cond_broadcast(&pool->start);
+
+    while (pool->pending > 0) {
+        pthread_cond_wait(&pool->done, &pool->lock);
+    }
+
+    pthread_mutex_unlock(&pool->lock);
+}
+
+void pool_cleanup(Pool pool)
+{
+    pthread_mutex_lock(&pool->lock);
+    pool->shutdown = 1;
+    pthread_cond_broadcast(&pool->start);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (int i = 0; i < pool->count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    pthread_cond_destroy(&pool->done);
+    pthread_cond_destroy(&pool->start);
+    pthread_mutex_destroy(&pool->lock);
+
+    free(pool->threads);
+    free(pool);
+}
+
+void pool_deque_init(Pool_Deque *deque, int capacity)
+{
+    pthread_mutex_init(&deque->lock, NULL);
+
+    deque->items = (int*) malloc(sizeof(int) * capacity);
+    deque->capacity = capacity;
+
+    deque->top = 0;
+    deque->bottom = 0;
+}
+
+void pool_deque_free(Pool_Deque *deque)
+{
+    pthread_mutex_destroy(&deque->lock);
+    free(deque->items);
+}
+
+void pool_deque_push(Pool_Deque *deque, int item)
+{
+    pthread_mutex_lock(&deque->lock);
+
+    deque->items[deque->bottom++] = item;
+
+    pthread_mutex_unlock(&deque->lock);
+}
+
+int pool_deque_pop(Pool_Deque *deque)
+{
+    int item = -1;
+
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->bottom > deque->top) {
+        item = deque->items[--deque->bottom];
+    }
+
+    // Start from the beginning again once it's empty
+    if (deque->bottom == deque->top) {
+        deque->top = 0;
+        deque->bottom = 0;
+    }
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return item;
+}
+
+int pool_deque_empty(Pool_Deque *deque)
+{
+    int empty;
+
+    pthread_mutex_lock(&deque->lock);
+    empty = deque->bottom == deque->top;
+    pthread_mutex_unlock(&deque->lock);
+
+    return empty;
+}
+
+int pool_deque_steal(Pool_Deque *deque)
+{
+    int item = -1;
+
+    pthread_mutex_lock(&deque->lock);
+
+    if (deque->bottom > deque->top) {
+        item = deque->items[deque->top++];
+    }
+
+    if (deque->bottom == deque->top) {
+        deque->top = 0;
+        deque->bottom = 0;
+    }
+
+    pthread_mutex_unlock(&deque->lock);
+
+    return item;
+}
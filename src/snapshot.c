@@ -0,0 +1,164 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+
+#include "mandelbrot.h"
+#include "snapshot.h"
+#include "palette.h"
+
+// Allocates one aligned block big enough for a full plane of the image
+static void *brot_plane_alloc(Mandelbrot brot, size_t elementSize)
+{
+    void *plane = NULL;
+
+    if (posix_memalign(&plane, BROT_PLANE_ALIGN, elementSize * brot->stride * brot->pixelHeight) != 0) {
+        return NULL;
+    }
+
+    return plane;
+}
+
+void brot_snapshot_free(Brot_Snapshot *snapshot)
+{
+    free(snapshot->canvas);
+
+    free(snapshot->raw_values);
+
+    free(snapshot->fraction_values);
+
+    brot_colour_scale_free(snapshot->scale);
+    free(snapshot->scale);
+
+    free(snapshot);
+}
+
+Brot_Snapshot *brot_snapshot_create(Mandelbrot brot)
+{
+    Brot_Snapshot *snapshot = (Brot_Snapshot*) malloc(sizeof(Brot_Snapshot));
+
+    snapshot->canvas = (uint32_t*) brot_plane_alloc(brot, sizeof(uint32_t));
+
+    snapshot->raw_values = (int*) brot_plane_alloc(brot, sizeof(int));
+
+    snapshot->fraction_values = (uint16_t*) brot_plane_alloc(brot, sizeof(uint16_t));
+
+    snapshot->computed = 0;
+
+    snapshot->scale = (Brot_Colour_Scale*) malloc(sizeof(Brot_Colour_Scale));
+    brot_colour_scale_linear(snapshot->scale, 0.0, 0.0);
+    snapshot->palette_version = -1;
+
+    snapshot->refs = 1;
+
+    return snapshot;
+}
+
+Brot_Snapshot *brot_snapshot_get(Mandelbrot brot)
+{
+    Brot_Snapshot *snapshot = brot->spare;
+
+    if (snapshot == NULL) {
+        return brot_snapshot_create(brot);
+    }
+
+    brot->spare = NULL;
+
+    snapshot->computed = 0;
+    snapshot->refs = 1;
+
+    return snapshot;
+}
+
+void brot_snapshot_retain(Brot_Snapshot *snapshot)
+{
+    snapshot->refs++;
+}
+
+void brot_snapshot_release(Mandelbrot brot, Brot_Snapshot *snapshot)
+{
+    snapshot->refs--;
+
+    if (snapshot->refs > 0) {
+        return;
+    }
+
+    if (brot->spare == NULL) {
+        brot->spare = snapshot;
+    } else {
+        brot_snapshot_free(snapshot);
+    }
+}
+
+void brot_snapshot_stamp(Mandelbrot brot, Brot_Snapshot *snapshot)
+{
+    snapshot->computed = 1;
+
+    snapshot->x1 = brot->x1;
+    snapshot->y1 = brot->y1;
+    snapshot->x2 = brot->x2;
+    snapshot->y2 = brot->y2;
+
+    snapshot->centerX = brot->centerX;
+    snapshot->centerY = brot->centerY;
+    snapshot->spanX = brot->spanX;
+    snapshot->spanY = brot->spanY;
+
+    snapshot->repeats = brot->repeats;
+    snapshot->interior_check = brot->interior_check;
+    snapshot->periodicity_check = brot->periodicity_check;
+
+    snapshot->precision = brot->precision;
+}
+
+int brot_snapshot_matches(Mandelbrot brot, Brot_Snapshot *snapshot)
+{
+    return snapshot->computed &&
+           snapshot->repeats == brot->repeats &&
+           snapshot->interior_check == brot->interior_check &&
+           snapshot->periodicity_check == brot->periodicity_check;
+}
+
+void brot_snapshot_use(Mandelbrot brot, Brot_Snapshot *snapshot)
+{
+    Brot_Snapshot *old = brot->current;
+
+    brot->current = snapshot;
+
+    brot->canvas = snapshot->canvas;
+    brot->raw_values = snapshot->raw_values;
+    brot->fraction_values = snapshot->fraction_values;
+
+    if (old != NULL) {
+        brot_snapshot_release(brot, old);
+    }
+}
+
+void brot_history_push(Mandelbrot brot)
+{
+    if (brot->current == NULL || !brot->current->computed) {
+        return;
+    }
+
+    if (brot->history_count == BROT_HISTORY_DEPTH) {
+        brot_snapshot_release(brot, brot->history[0]);
+        for (int i = 1; i < BROT_HISTORY_DEPTH; i++) {
+            brot->history[i - 1] = brot->history[i];
+        }
+        brot->history_count--;
+    }
+
+    brot_snapshot_retain(brot->current);
+    brot->history[brot->history_count] = brot->current;
+    brot->history_count++;
+}
+
+Brot_Snapshot *brot_history_pop(Mandelbrot brot)
+{
+    if (brot->history_count == 0) {
+        return NULL;
+    }
+
+    brot->history_count--;
+
+    return brot->history[brot->history_count];
+}
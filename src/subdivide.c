@@ -0,0 +1,153 @@
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "mandelbrot.h"
+#include "subdivide.h"
+
+// All the rectangles below use inclusive pixel coordinates
+// and by the time a rectangle is looked at its border has been calculated
+
+// Calculates part of a row with the brot's kernel
+static void brot_calc_row(Mandelbrot brot, int yPos, int xStart, int xEnd)
+{
+    int index = yPos * brot->stride + xStart;
+
+    if (xEnd > xStart) {
+        brot->kernel(brot, xStart, yPos, xEnd - xStart, 1,
+                     brot->fraction_values + index, brot->raw_values + index);
+    }
+}
+
+// Calculates part of a column, one pixel at a time as the kernels
+// can only work along rows
+static void brot_calc_column(Mandelbrot brot, int xPos, int yStart, int yEnd)
+{
+    int index;
+
+    for (int yPos = yStart; yPos < yEnd; yPos++) {
+        index = yPos * brot->stride + xPos;
+        brot->kernel(brot, xPos, yPos, 1, 1, brot->fraction_values + index, brot->raw_values + index);
+    }
+}
+
+// Checks if every pixel on the border of the rectangle escaped on the same
+// iteration, and if so gives back that iteration count
+static int brot_border_uniform(Mandelbrot brot, int x0, int y0, int x1, int y1, int *raw)
+{
+    int *top = brot->raw_values + y0 * brot->stride;
+    int *bottom = brot->raw_values + y1 * brot->stride;
+    int *row;
+
+    int value = top[x0];
+
+    for (int xPos = x0; xPos <= x1; xPos++) {
+        if (top[xPos] != value || bottom[xPos] != value) {
+            return 0;
+        }
+    }
+
+    for (int yPos = y0 + 1; yPos < y1; yPos++) {
+        row = brot->raw_values + yPos * brot->stride;
+        if (row[x0] != value || row[x1] != value) {
+            return 0;
+        }
+    }
+
+    *raw = value;
+
+    return 1;
+}
+
+// Fills the inside of the rectangle without iterating
+// Points in the set are all given the in set value, otherwise the fractions
+// are interpolated across from the border. The whole border escaped on the
+// same iteration, so that's the same as interpolating the smooth values
+static void brot_fill_rectangle(Mandelbrot brot, int x0, int y0, int x1, int y1, int raw)
+{
+    uint16_t *top = brot->fraction_values + y0 * brot->stride;
+    uint16_t *bottom = brot->fraction_values + y1 * brot->stride;
+    uint16_t *fraction;
+    int *raws;
+
+    double across, down;
+
+    for (int yPos = y0 + 1; yPos < y1; yPos++) {
+        fraction = brot->fraction_values + yPos * brot->stride;
+        raws = brot->raw_values + yPos * brot->stride;
+
+        double yFrac = (double)(yPos - y0) / (y1 - y0);
+
+        for (int xPos = x0 + 1; xPos < x1; xPos++) {
+            raws[xPos] = raw;
+
+            if (raw == brot->repeats) {
+                fraction[xPos] = 0;
+            } else {
+                double xFrac = (double)(xPos - x0) / (x1 - x0);
+
+                across = fraction[x0] + (fraction[x1] - fraction[x0]) * xFrac;
+                down = top[xPos] + (bottom[xPos] - top[xPos]) * yFrac;
+
+                fraction[xPos] = (uint16_t)((across + down) / 2.0 + 0.5);
+            }
+        }
+    }
+}
+
+static void brot_subdivide(Mandelbrot brot, int x0, int y0, int x1, int y1)
+{
+    int raw;
+
+    // Nothing left inside the border
+    if (x1 - x0 < 2 || y1 - y0 < 2) {
+        return;
+    }
+
+    if (brot_border_uniform(brot, x0, y0, x1, y1, &raw)) {
+        if (raw == brot->repeats || brot->render_mode == BROT_RENDER_SUBDIVIDE_GUESS) {
+            brot_fill_rectangle(brot, x0, y0, x1, y1, raw);
+            return;
+        }
+    }
+
+    if (x1 - x0 <= BROT_SUBDIVIDE_MIN || y1 - y0 <= BROT_SUBDIVIDE_MIN) {
+        for (int yPos = y0 + 1; yPos < y1; yPos++) {
+            brot_calc_row(brot, yPos, x0 + 1, x1);
+        }
+        return;
+    }
+
+    // Split into quarters, the dividing row and column are the new borders
+    int xMid = (x0 + x1) / 2;
+    int yMid = (y0 + y1) / 2;
+
+    brot_calc_row(brot, yMid, x0 + 1, x1);
+    brot_calc_column(brot, xMid, y0 + 1, yMid);
+    brot_calc_column(brot, xMid, yMid + 1, y1);
+
+    brot_subdivide(brot, x0, y0, xMid, yMid);
+    brot_subdivide(brot, xMid, y0, x1, yMid);
+    brot_subdivide(brot, x0, yMid, xMid, y1);
+    brot_subdivide(brot, xMid, yMid, x1, y1);
+}
+
+void brot_subdivide_tile(Mandelbrot brot, int xStart, int yStart, int xEnd, int yEnd)
+{
+    int x0 = xStart;
+    int y0 = yStart;
+    int x1 = xEnd - 1;
+    int y1 = yEnd - 1;
+
+    // The border of the whole tile
+    brot_calc_row(brot, y0, x0, x1 + 1);
+    if (y1 > y0) {
+        brot_calc_row(brot, y1, x0, x1 + 1);
+    }
+
+    brot_calc_column(brot, x0, y0 + 1, y1);
+    if (x1 > x0) {
+        brot_calc_column(brot, x1, y0 + 1, y1);
+    }
+
+    brot_subdivide(brot, x0, y0, x1, y1);
+}